@@ -0,0 +1,415 @@
+#include <nemu/ppu.h>
+#include <nemu/spritedma.h>
+#include <nemu/mapper/mapper.h>
+#include <nemu/ppu/palette.h>
+#include <nemu/ppu/pixelconverter.h>
+#include <nemu/memory/dispatcher.h>
+#include <nemu/memory/ram.h>
+#include <nemu/memory/rom.h>
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <stdlib.h>
+
+// =====================================================================================================================
+/// Times a kernel over a number of runs and prints the mean, standard deviation and minimum of the ns/op figures.
+class Benchmark
+{
+    public:
+	Benchmark(unsigned runs)
+	    : m_runs(runs)
+	{}
+
+	/// runs the kernel and reports its figures, the kernel has to do exactly ops operations per call
+	void run(const std::string& name, unsigned ops, const std::function<void()>& kernel)
+	{
+	    // warm up caches and branch predictors
+	    kernel();
+
+	    // calibrate the number of calls so one run takes around 10ms
+	    unsigned calls = 1;
+
+	    while (time(kernel, calls) < 10000000.0)
+		calls *= 2;
+
+	    std::vector<double> samples;
+
+	    for (unsigned i = 0; i < m_runs; ++i)
+		samples.push_back(time(kernel, calls) / (double(calls) * ops));
+
+	    double mean = 0;
+	    double min = samples[0];
+
+	    for (double s : samples)
+	    {
+		mean += s;
+		min = std::min(min, s);
+	    }
+
+	    mean /= samples.size();
+
+	    double variance = 0;
+
+	    for (double s : samples)
+		variance += (s - mean) * (s - mean);
+
+	    variance /= samples.size();
+
+	    std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(3)
+		      << std::setw(12) << mean << " ns/op"
+		      << "  +- " << std::setw(8) << std::sqrt(variance)
+		      << "  min " << std::setw(10) << min << std::endl;
+	}
+
+    private:
+	/// returns the time of calling the kernel the given times in nanoseconds
+	double time(const std::function<void()>& kernel, unsigned calls)
+	{
+	    auto start = std::chrono::steady_clock::now();
+
+	    for (unsigned i = 0; i < calls; ++i)
+		kernel();
+
+	    auto end = std::chrono::steady_clock::now();
+
+	    return std::chrono::duration<double, std::nano>(end - start).count();
+	}
+
+    private:
+	unsigned m_runs;
+};
+
+// =====================================================================================================================
+/// stand-in for memory mapped I/O registers on the CPU bus
+class IoRegisters : public lib6502::Memory
+{
+    public:
+	uint8_t read(uint16_t address) override
+	{ return address; }
+
+	void write(uint16_t address, uint8_t data) override
+	{}
+};
+
+static volatile unsigned s_sink;
+
+// =====================================================================================================================
+static std::shared_ptr<memory::ROM> createRom(unsigned size, std::mt19937& random)
+{
+    uint8_t* data = new uint8_t[size];
+
+    for (unsigned i = 0; i < size; ++i)
+	data[i] = random();
+
+    return std::make_shared<memory::ROM>(data, size);
+}
+
+// =====================================================================================================================
+static std::vector<uint16_t> createAddresses(std::mt19937& random, unsigned ram, unsigned rom, unsigned io)
+{
+    std::vector<uint16_t> addresses;
+    unsigned total = ram + rom + io;
+
+    for (unsigned i = 0; i < 4096; ++i)
+    {
+	unsigned r = random() % total;
+
+	if (r < ram)
+	    addresses.push_back(random() % 0x2000);
+	else if (r < ram + rom)
+	    addresses.push_back(0x8000 + random() % 0x8000);
+	else
+	    addresses.push_back(0x4000 + random() % 0x14);
+    }
+
+    return addresses;
+}
+
+// =====================================================================================================================
+static void benchmarkBus(Benchmark& bench, std::mt19937& random)
+{
+    memory::Dispatcher bus;
+
+    // same layout as the emulator: mirrored system RAM, PPU registers, APU registers and 16kB of mirrored PRG ROM
+    std::shared_ptr<memory::RAM> ram = std::make_shared<memory::RAM>(0x800);
+    for (unsigned i = 0; i < 4; ++i)
+	bus.registerHandler(i * 0x800, 0x800, ram);
+
+    bus.registerHandler(0x2000, 8, std::make_shared<IoRegisters>());
+    bus.registerHandler(0x4016, 2, std::make_shared<IoRegisters>());
+    bus.registerHandler(0x4014, 1, std::make_shared<IoRegisters>());
+    bus.registerHandler(0x4000, 0x14, std::make_shared<memory::RAM>(0x14));
+    bus.registerHandler(0x4015, 0x1, std::make_shared<memory::RAM>(0x1));
+
+    std::shared_ptr<memory::ROM> rom = createRom(0x4000, random);
+    bus.registerHandler(0x8000, rom->size(), rom);
+    bus.registerHandler(0xc000, rom->size(), rom);
+
+    struct Mix
+    {
+	const char* m_name;
+	/// false if the mix contains ROM addresses
+	bool m_writable;
+	std::vector<uint16_t> m_addresses;
+    };
+
+    Mix mixes[] = {
+	{"ram", true, createAddresses(random, 1, 0, 0)},
+	{"rom", false, createAddresses(random, 0, 1, 0)},
+	{"io", true, createAddresses(random, 0, 0, 1)},
+	{"typical (70rom/25ram/5io)", false, createAddresses(random, 25, 70, 5)}
+    };
+
+    for (const Mix& mix : mixes)
+    {
+	const std::vector<uint16_t>& addresses = mix.m_addresses;
+
+	bench.run(std::string("bus read ") + mix.m_name, addresses.size(), [&]() {
+	    unsigned sum = 0;
+	    for (uint16_t address : addresses)
+		sum += bus.read(address);
+	    s_sink = sum;
+	});
+    }
+
+    // writes to ROM are invalid so only the RAM and I/O mixes are measured
+    for (const Mix& mix : mixes)
+    {
+	if (!mix.m_writable)
+	    continue;
+
+	const std::vector<uint16_t>& addresses = mix.m_addresses;
+
+	bench.run(std::string("bus write ") + mix.m_name, addresses.size(), [&]() {
+	    uint8_t data = 0;
+	    for (uint16_t address : addresses)
+		bus.write(address, data++);
+	});
+    }
+}
+
+// =====================================================================================================================
+static void writeVram(PPU& ppu, uint16_t address, uint8_t data)
+{
+    ppu.write(PPU::PPUADDR, address >> 8);
+    ppu.write(PPU::PPUADDR, address & 0xff);
+    ppu.write(PPU::PPUDATA, data);
+}
+
+// =====================================================================================================================
+static void benchmarkPpu(Benchmark& bench, std::mt19937& random)
+{
+    PPU ppu(createRom(0x2000, random));
+
+    // synthetic name tables, attribute tables and palette
+    for (unsigned address = 0x2000; address < 0x3000; ++address)
+	writeVram(ppu, address, random());
+
+    for (unsigned address = 0x3f00; address < 0x3f20; ++address)
+	writeVram(ppu, address, random() % 64);
+
+    // spread the sprites over the screen, a few of them share lines
+    const std::shared_ptr<SpriteMemory>& oam = ppu.spriteRam();
+
+    for (unsigned i = 0; i < 64; ++i)
+    {
+	oam->write(i * 4 + 0, random() % 232);
+	oam->write(i * 4 + 1, random());
+	oam->write(i * 4 + 2, random() & 0xe3);
+	oam->write(i * 4 + 3, random());
+    }
+
+    ppu.write(PPU::PPUCTRL, 0x08);
+    ppu.write(PPU::PPUSCROLL, 13);
+    ppu.write(PPU::PPUSCROLL, 0);
+
+    // the visible lines of a frame are 20..259
+    bench.run("ppu renderScanLine", 240, [&]() {
+	for (unsigned line = 20; line < 260; ++line)
+	    ppu.renderScanLine(line);
+    });
+
+    bench.run("ppu renderSpriteLine", 240, [&]() {
+	for (unsigned line = 20; line < 260; ++line)
+	    ppu.renderSpriteLine(line);
+    });
+
+    bench.run("ppu outputScanLine", 240, [&]() {
+	for (unsigned line = 20; line < 260; ++line)
+	    ppu.outputScanLine(line);
+    });
+
+    // whole frames as run-ahead emulates them, with and without producing the pixels
+    ppu.setNmiCallback([]() {});
+
+    bench.run("ppu frame", 1, [&]() {
+	unsigned frame = ppu.frameCount();
+	while (ppu.frameCount() == frame)
+	    ppu.tick();
+    });
+
+    ppu.setVideoOutput(false);
+
+    bench.run("ppu frame without video", 1, [&]() {
+	unsigned frame = ppu.frameCount();
+	while (ppu.frameCount() == frame)
+	    ppu.tick();
+    });
+
+    ppu.setVideoOutput(true);
+
+    std::vector<uint8_t> state;
+
+    bench.run("ppu save + load state", 1, [&]() {
+	state.clear();
+	StateWriter writer(state);
+	ppu.saveState(writer);
+
+	StateReader reader(state.data(), state.size());
+	ppu.loadState(reader);
+    });
+
+    // re-pointing the name table slots, mappers like MMC1 switch the mirroring during the frame
+    unsigned mirroring = 0;
+
+    bench.run("ppu mirroring switch", 1, [&]() {
+	ppu.setMirroring(Mirroring(mirroring++ % 4));
+    });
+}
+
+// =====================================================================================================================
+static void benchmarkMapper(Benchmark& bench, std::mt19937& random)
+{
+    memory::Dispatcher bus;
+    PPU ppu(createRom(0x20000, random));
+
+    // 16kB PRG banks switched through a single register write
+    std::shared_ptr<Mapper> uxrom = Mapper::create(2, createRom(0x40000, random), createRom(0x2000, random));
+    uxrom->attach(bus, ppu);
+
+    bench.run("bank switch UxROM (16kB PRG)", 256, [&]() {
+	for (unsigned bank = 0; bank < 256; ++bank)
+	    bus.write(0x8000, bank);
+    });
+
+    // 8kB PRG and 1-2kB CHR banks of the MMC3, the bank data write remaps all windows
+    memory::Dispatcher mmc3Bus;
+    std::shared_ptr<Mapper> mmc3 = Mapper::create(4, createRom(0x40000, random), createRom(0x20000, random));
+    mmc3->attach(mmc3Bus, ppu);
+
+    bench.run("bank switch MMC3 (all windows)", 256, [&]() {
+	for (unsigned bank = 0; bank < 256; ++bank)
+	{
+	    mmc3Bus.write(0x8000, bank & 7);
+	    mmc3Bus.write(0x8001, bank);
+	}
+    });
+}
+
+// =====================================================================================================================
+static void benchmarkPalette(Benchmark& bench, std::mt19937& random)
+{
+    PaletteMemory palette;
+
+    for (unsigned i = 0; i < 0x20; ++i)
+	palette.write(i, random() % 64);
+
+    bench.run("palette read", 256, [&]() {
+	unsigned sum = 0;
+	for (unsigned i = 0; i < 256; ++i)
+	    sum += palette.read(i & 0x1f);
+	s_sink = sum;
+    });
+}
+
+// =====================================================================================================================
+static void benchmarkPixelConverter(Benchmark& bench, std::mt19937& random)
+{
+    static const char* names[] = {"scalar", "ssse3", "avx2"};
+
+    uint32_t colors[32];
+    for (unsigned i = 0; i < 32; ++i)
+	colors[i] = random() & 0xffffff;
+
+    std::vector<uint8_t> indices(256 * 240);
+    for (uint8_t& index : indices)
+	index = random() % 32;
+
+    std::vector<uint32_t> pixels(indices.size());
+
+    for (unsigned i = PixelConverter::SCALAR; i <= PixelConverter::AVX2; ++i)
+    {
+	PixelConverter::Implementation implementation = static_cast<PixelConverter::Implementation>(i);
+
+	if (!PixelConverter::isSupported(implementation))
+	    continue;
+
+	PixelConverter converter(implementation);
+
+	bench.run(std::string("pixel convert frame ") + names[i], indices.size(), [&]() {
+	    converter.convert(indices.data(), pixels.data(), indices.size(), colors);
+	});
+    }
+}
+
+// =====================================================================================================================
+static void benchmarkSpriteDma(Benchmark& bench, std::mt19937& random)
+{
+    memory::Dispatcher bus;
+
+    std::shared_ptr<memory::RAM> ram = std::make_shared<memory::RAM>(0x800);
+    for (unsigned i = 0; i < 4; ++i)
+	bus.registerHandler(i * 0x800, 0x800, ram);
+
+    for (unsigned i = 0; i < 0x800; ++i)
+	ram->write(i, random());
+
+    SpriteMemory oam;
+    uint64_t cycles = 0;
+    SpriteDMA dma(bus, oam, cycles);
+
+    bench.run("sprite DMA (per transfer)", 1, [&]() {
+	dma.write(0, 0x02);
+    });
+
+    // a page shared by two handlers has no direct mapping, it falls back to reads through the handlers
+    std::shared_ptr<memory::RAM> io = std::make_shared<memory::RAM>(0x80);
+    bus.registerHandler(0x4000, 0x80, io);
+    bus.registerHandler(0x4080, 0x80, io);
+
+    bench.run("sprite DMA from I/O page (per transfer)", 1, [&]() {
+	dma.write(0, 0x40);
+    });
+}
+
+// =====================================================================================================================
+int main(int argc, char** argv)
+{
+    unsigned runs = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20;
+
+    if (runs == 0)
+    {
+	std::cerr << "Usage: " << argv[0] << " [runs]" << std::endl;
+	return 1;
+    }
+
+    // fixed seed so the synthetic contents are the same for each build being compared
+    std::mt19937 random(0x6502);
+
+    Benchmark bench(runs);
+
+    benchmarkBus(bench, random);
+    benchmarkPpu(bench, random);
+    benchmarkMapper(bench, random);
+    benchmarkPalette(bench, random);
+    benchmarkPixelConverter(bench, random);
+    benchmarkSpriteDma(bench, random);
+
+    return 0;
+}
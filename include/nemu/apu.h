@@ -0,0 +1,215 @@
+#ifndef NEMU_APU_H_INCLUDED
+#define NEMU_APU_H_INCLUDED
+
+#include <nemu/blipbuffer.h>
+#include <nemu/state.h>
+#include <nemu/memory/dispatcher.h>
+
+#include <functional>
+#include <vector>
+
+/// The audio processing unit at $4000-$4013, $4015 and $4017 with two pulse channels, the triangle, noise and DMC
+/// channels and the frame counter. The APU is not clocked along with the CPU. Its channels are advanced in one batch up
+/// to the current CPU cycle when a register is accessed, when an IRQ is due and at the end of a frame, and only the
+/// changes of their output levels are synthesized, as band-limited steps.
+class APU : public lib6502::Memory
+{
+    public:
+	/// the DMC fetches its samples from the bus, the cycle counter of the machine is the time base of the APU
+	APU(memory::Dispatcher& memory, const uint64_t& cycles);
+
+	void setIrqCallback(const std::function<void()>& irqCallback);
+	/// receives the samples of each frame, nothing is synthesized without a callback
+	void setSampleCallback(const std::function<void(const int16_t*, unsigned)>& sampleCallback);
+
+	/// sets the output sample rate, it may be adjusted between frames to keep the audio output in sync
+	void setSampleRate(double sampleRate);
+	/// disables synthesis for frames that are emulated again later, the channels keep running
+	void setAudioOutput(bool enabled);
+
+	/// the CPU cycle the APU has to be updated at to raise its next IRQ in time, checked after every CPU cycle
+	uint64_t nextEvent() const
+	{ return m_nextEvent; }
+
+	/// advances the channels to the current CPU cycle
+	void update();
+	/// advances the channels to the current CPU cycle and passes the samples of the frame to the sample callback
+	void endFrame();
+
+	void saveState(StateWriter& writer) const;
+	void loadState(StateReader& reader);
+
+	uint8_t read(uint16_t address) override;
+	void write(uint16_t address, uint8_t data) override;
+
+    private:
+	/// indices of the output levels of the channels
+	enum Channel
+	{
+	    PULSE1,
+	    PULSE2,
+	    TRIANGLE,
+	    NOISE,
+	    DMC,
+
+	    CHANNEL_COUNT
+	};
+
+	// The timer counters hold the CPU cycles left until the next clock of the channel, they are never zero.
+
+	struct Envelope
+	{
+	    bool m_start;
+	    /// also halts the length counter
+	    bool m_loop;
+	    bool m_constant;
+	    /// the constant volume or the period of the decay
+	    uint8_t m_volume;
+	    uint8_t m_divider;
+	    uint8_t m_decay;
+	};
+
+	struct Pulse
+	{
+	    Envelope m_envelope;
+	    bool m_enabled;
+	    uint8_t m_duty;
+	    uint8_t m_step;
+	    uint8_t m_length;
+	    uint16_t m_timer;
+	    uint32_t m_counter;
+
+	    bool m_sweepEnabled;
+	    bool m_sweepNegate;
+	    bool m_sweepReload;
+	    uint8_t m_sweepPeriod;
+	    uint8_t m_sweepShift;
+	    uint8_t m_sweepDivider;
+	};
+
+	struct Triangle
+	{
+	    bool m_enabled;
+	    /// also halts the length counter
+	    bool m_control;
+	    bool m_linearReload;
+	    uint8_t m_linearPeriod;
+	    uint8_t m_linear;
+	    uint8_t m_length;
+	    uint8_t m_step;
+	    uint16_t m_timer;
+	    uint32_t m_counter;
+	};
+
+	struct Noise
+	{
+	    Envelope m_envelope;
+	    bool m_enabled;
+	    bool m_shortMode;
+	    uint8_t m_period;
+	    uint8_t m_length;
+	    uint16_t m_shift;
+	    uint32_t m_counter;
+	};
+
+	struct Dmc
+	{
+	    bool m_irqEnabled;
+	    bool m_loop;
+	    uint8_t m_rate;
+	    uint8_t m_level;
+	    uint16_t m_sampleAddress;
+	    uint16_t m_sampleLength;
+	    uint32_t m_counter;
+
+	    // memory reader
+	    uint16_t m_address;
+	    uint16_t m_remaining;
+	    uint8_t m_buffer;
+	    bool m_bufferFull;
+
+	    // output unit
+	    uint8_t m_shift;
+	    uint8_t m_bits;
+	    bool m_silence;
+	};
+
+	/// advances the channels and the frame counter to the given cycle
+	void run(uint64_t until);
+
+	/// Advance the channels over a range of cycles without frame counter clocks. Every change of an output level is
+	/// added at the cycle it happens at.
+	void runPulse(unsigned channel, uint64_t from, uint64_t to);
+	void runTriangle(uint64_t from, uint64_t to);
+	void runNoise(uint64_t from, uint64_t to);
+	void runDmc(uint64_t from, uint64_t to);
+
+	void clockFrameCounter();
+	/// envelopes and the linear counter
+	void quarterFrame();
+	/// length counters and sweeps
+	void halfFrame();
+
+	void clockEnvelope(Envelope& envelope);
+	void clockSweep(unsigned channel);
+	uint8_t envelopeVolume(const Envelope& envelope) const;
+	unsigned sweepTarget(unsigned channel) const;
+	/// true if the period of the pulse channel is out of range
+	bool pulseMuted(unsigned channel) const;
+
+	/// fills the sample buffer of the DMC if it is empty and bytes of the sample are left
+	void dmcFetch();
+	void dmcRestart();
+
+	/// updates the output levels after a register write changed them without a clock of the channel
+	void updateLevels();
+	/// sets the output level of a channel at a cycle and adds the change of the mixed output to the synthesis
+	void setLevel(unsigned channel, uint8_t level, uint64_t time);
+	/// the non-linear mix of the current output levels
+	float mix() const;
+
+	void raiseIrq();
+	void updateNextEvent();
+
+	// Every field is saved on its own. The loaded table indices and output levels are checked before they are used.
+	static void saveEnvelope(StateWriter& writer, const Envelope& envelope);
+	static void loadEnvelope(StateReader& reader, Envelope& envelope);
+	static void savePulse(StateWriter& writer, const Pulse& pulse);
+	static void loadPulse(StateReader& reader, Pulse& pulse);
+
+	memory::Dispatcher& m_memory;
+	const uint64_t& m_cycles;
+
+	std::function<void()> m_irqCallback;
+	std::function<void(const int16_t*, unsigned)> m_sampleCallback;
+
+	/// the cycle the channels were advanced to
+	uint64_t m_time;
+	/// the cycle the current audio frame started at
+	uint64_t m_frameStart;
+	uint64_t m_nextEvent;
+
+	Pulse m_pulse[2];
+	Triangle m_triangle;
+	Noise m_noise;
+	Dmc m_dmc;
+
+	// frame counter
+	bool m_fiveStep;
+	bool m_irqInhibit;
+	bool m_frameIrq;
+	bool m_dmcIrq;
+	unsigned m_frameStep;
+	/// cycles since the start of the frame counter sequence
+	uint32_t m_frameCycle;
+
+	bool m_audioOutput;
+	uint8_t m_levels[CHANNEL_COUNT];
+	/// the mixed output the synthesis is at
+	float m_mix;
+
+	BlipBuffer m_blip;
+	std::vector<int16_t> m_samples;
+};
+
+#endif
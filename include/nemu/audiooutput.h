@@ -0,0 +1,53 @@
+#ifndef NEMU_AUDIOOUTPUT_H_INCLUDED
+#define NEMU_AUDIOOUTPUT_H_INCLUDED
+
+#include <nemu/audioqueue.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+class AudioException : public std::runtime_error
+{
+    public:
+	AudioException(const std::string& error)
+	    : runtime_error(error)
+	{}
+};
+
+/// Plays the samples of the emulation through SDL. The samples are queued in a lock-free ring that the audio callback
+/// of SDL drains on its own thread, neither side ever waits for the other.
+///
+/// The emulation is paced by the video, so the samples are not produced at exactly the rate the device consumes them.
+/// Instead of dropping or repeating samples the emulation is asked to resample slightly faster or slower depending on
+/// how far the queue is from half full, a change of the pitch of at most 0.5% that cannot be heard.
+class AudioOutput
+{
+    public:
+	/// opens the audio device, throws AudioException if it is not available
+	AudioOutput(unsigned sampleRate = 48000);
+	~AudioOutput();
+
+	/// queues samples for playback, the device starts once the queue is half full (emulation thread only)
+	void submit(const int16_t* samples, unsigned count);
+
+	/// the rate the emulation has to produce samples at to keep the queue half full
+	double sampleRate() const;
+
+	/// number of device callbacks that found the queue empty since playback started
+	unsigned underruns() const;
+
+    private:
+	/// the audio callback of SDL
+	static void fill(void* userdata, uint8_t* stream, int length);
+
+	unsigned m_sampleRate;
+	AudioQueue m_queue;
+	bool m_playing;
+
+	/// the last sample played, repeated on underruns to avoid clicks
+	int16_t m_lastSample;
+	std::atomic<unsigned> m_underruns;
+};
+
+#endif
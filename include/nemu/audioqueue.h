@@ -0,0 +1,38 @@
+#ifndef NEMU_AUDIOQUEUE_H_INCLUDED
+#define NEMU_AUDIOQUEUE_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/// Lock-free single producer / single consumer ring of audio samples. Neither side ever waits, samples pushed into a
+/// full ring are dropped and a read from an empty ring returns fewer samples.
+class AudioQueue
+{
+    public:
+	/// the capacity in samples has to be a power of two
+	AudioQueue(unsigned capacity);
+
+	/// appends samples, returns the number that fit (producer only)
+	unsigned push(const int16_t* samples, unsigned count);
+
+	/// takes up to the given number of the oldest samples, returns the number taken (consumer only)
+	unsigned pop(int16_t* samples, unsigned count);
+
+	/// number of samples queued, may be outdated by the time it returns
+	unsigned size() const;
+	unsigned capacity() const;
+
+    private:
+	unsigned m_capacity;
+	std::vector<int16_t> m_samples;
+
+	// The positions are only incremented and each of them is written by one side only. The padding keeps them on
+	// separate cache lines.
+	std::atomic<unsigned> m_head;
+	char m_headPadding[64 - sizeof(std::atomic<unsigned>)];
+	std::atomic<unsigned> m_tail;
+	char m_tailPadding[64 - sizeof(std::atomic<unsigned>)];
+};
+
+#endif
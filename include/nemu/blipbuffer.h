@@ -0,0 +1,51 @@
+#ifndef NEMU_BLIPBUFFER_H_INCLUDED
+#define NEMU_BLIPBUFFER_H_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+/// Band-limited step synthesis. Sources report the changes of their output level at the clock they happen at, each
+/// change is added as a band-limited step to the samples around it. Nothing has to be done for the clocks between
+/// changes, so the cost depends on the number of level changes and not on the clock rate.
+class BlipBuffer
+{
+    public:
+	/// the buffer holds up to the given number of samples not yet read
+	BlipBuffer(unsigned capacity);
+
+	/// sets the number of clocks per second of the sources and the output sample rate, may be changed between frames
+	void setRates(double clockRate, double sampleRate);
+
+	/// adds a level change of the given size at a clock relative to the start of the current frame
+	void addDelta(uint32_t clock, float delta);
+
+	/// ends the current frame after the given number of clocks, its samples become available
+	void endFrame(uint32_t clocks);
+
+	unsigned samplesAvailable() const;
+
+	/// Reads up to the given number of samples, returns the number read. The DC offset of the mixed levels is
+	/// filtered out.
+	unsigned readSamples(int16_t* samples, unsigned count);
+
+	/// drops all samples and steps in progress
+	void clear();
+
+    private:
+	/// samples per clock as 32.32 fixed point
+	uint64_t m_factor;
+	/// position of the start of the current frame in the buffer as 32.32 fixed point
+	uint64_t m_offset;
+
+	/// the impulses of the level changes, samples are the running sum of them
+	std::vector<float> m_buffer;
+	unsigned m_capacity;
+	unsigned m_available;
+
+	float m_integrator;
+	/// state of the DC blocking high-pass
+	float m_lastInput;
+	float m_lastOutput;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef NEMU_CPUTRACE_H_INCLUDED
+#define NEMU_CPUTRACE_H_INCLUDED
+
+#include <nemu/memory/dispatcher.h>
+
+#include <lib6502/cpu.h>
+
+#include <cstdint>
+#include <string>
+
+/// one executed instruction, fixed size so the trace can be indexed and written without formatting
+struct CpuTraceRecord
+{
+    enum
+    {
+	/// the CPU was executing an interrupt handler
+	IN_INTERRUPT = 0x01
+    };
+
+    /// CPU cycles executed before the instruction
+    uint64_t m_tick;
+    uint16_t m_PC;
+    uint8_t m_A;
+    uint8_t m_X;
+    uint8_t m_Y;
+    uint8_t m_status;
+    uint8_t m_SP;
+    uint8_t m_flags;
+    /// the opcode and the two bytes following it, zero if they are in I/O space
+    uint8_t m_opcode[3];
+    uint8_t m_reserved[5];
+};
+
+static_assert(sizeof(CpuTraceRecord) == 24, "the trace file layout depends on the record size");
+
+/// header of a trace file, followed by the ring of records
+struct CpuTraceHeader
+{
+    char m_magic[4];
+    uint32_t m_version;
+    uint32_t m_recordSize;
+    /// number of records in the ring, a power of two
+    uint32_t m_capacity;
+    /// number of records written, the oldest one is at m_count % m_capacity once the ring wrapped around
+    uint64_t m_count;
+};
+
+/// Records the executed instructions into a ring of binary records in a shared file mapping. Nothing is formatted or
+/// flushed while emulating, the page cache holds the ring and writes it back when the kernel decides to, it survives
+/// a crash of the emulator. nemu-tracefmt turns a trace into text.
+class CpuTrace : public lib6502::InstructionTracer
+{
+    public:
+	static const char s_magic[4];
+	static const uint32_t s_version = 1;
+
+	/// Creates the trace file with room for capacity records (rounded up to a power of two). The opcode bytes are
+	/// peeked from the bus, the tick is read from cycles. Throws std::system_error if the file can not be created.
+	CpuTrace(const std::string& file, unsigned capacity, const memory::Dispatcher& bus, const uint64_t& cycles);
+	~CpuTrace();
+
+	CpuTrace(const CpuTrace&) = delete;
+	CpuTrace& operator=(const CpuTrace&) = delete;
+
+	/// only instructions in the PC range are recorded
+	void setRange(uint16_t first, uint16_t last);
+	/// recording starts the first time the instruction at the given address is executed
+	void setTrigger(uint16_t address);
+
+	/// number of records written
+	uint64_t count() const;
+
+	/// the disassembled instruction is not used, the opcode bytes are recorded instead
+	void trace(const lib6502::Cpu::State& state, const std::string& inst) override;
+
+    private:
+	const memory::Dispatcher& m_bus;
+	const uint64_t& m_cycles;
+
+	uint16_t m_first;
+	uint16_t m_last;
+
+	/// false while waiting for the trigger
+	bool m_triggered;
+	uint16_t m_trigger;
+
+	void* m_mapping;
+	size_t m_mappingSize;
+
+	CpuTraceHeader* m_header;
+	CpuTraceRecord* m_records;
+	uint32_t m_mask;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef NEMU_FRAMEPACER_H_INCLUDED
+#define NEMU_FRAMEPACER_H_INCLUDED
+
+#include <cstdint>
+
+/// Paces emulated frames against absolute deadlines on the monotonic clock so sleeping late does not accumulate. The
+/// tail of each wait is spun to hit the deadline accurately.
+class FramePacer
+{
+    public:
+	/// frame rate of the NTSC PPU
+	static const double FRAME_RATE;
+
+	static const double MIN_SPEED;
+	static const double MAX_SPEED;
+
+	FramePacer();
+
+	/// sets the emulation speed as a multiple of the real frame rate, restarts the schedule
+	void setSpeed(double speed);
+	double speed() const;
+
+	/// runs as fast as possible while turbo mode is enabled, restarts the schedule when it is disabled
+	void setTurbo(bool turbo);
+	bool turbo() const;
+
+	/// waits until the deadline of the next frame
+	void wait();
+
+	/// true if the deadline was already over when wait() was called for the last frame
+	bool late() const;
+
+	/// number of frames the deadline was already over when wait() was called
+	uint64_t missedDeadlines() const;
+	/// the latest a frame arrived after its deadline in nanoseconds
+	uint64_t maxLateness() const;
+
+	/// current time of the monotonic clock in nanoseconds
+	static uint64_t now();
+
+    private:
+	/// starts a new schedule with the next deadline one frame period from now
+	void restart();
+
+    private:
+	double m_speed;
+	bool m_turbo;
+
+	/// frame period in nanoseconds at the current speed
+	double m_period;
+
+	/// deadlines are computed from the start of the schedule to avoid accumulating rounding errors
+	uint64_t m_start;
+	uint64_t m_frames;
+
+	bool m_late;
+	uint64_t m_missedDeadlines;
+	uint64_t m_maxLateness;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef NEMU_FRAMEQUEUE_H_INCLUDED
+#define NEMU_FRAMEQUEUE_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/// Lock-free single producer / single consumer ring of preallocated 256x240 frame buffers. The producer never waits,
+/// a frame pushed while every buffer is in use is dropped.
+class FrameQueue
+{
+    public:
+	enum
+	{
+	    FRAME_SIZE = 256 * 240
+	};
+
+	/// the capacity has to be a power of two
+	FrameQueue(unsigned capacity);
+
+	/// copies a frame to the next free buffer, returns false if the frame was dropped (producer only)
+	bool push(const uint32_t* frame);
+
+	/// returns the oldest frame or nullptr if the queue is empty (consumer only)
+	const uint32_t* front() const;
+	/// releases the buffer of the oldest frame (consumer only)
+	void pop();
+
+	/// number of frames queued, may be outdated by the time it returns
+	unsigned size() const;
+	/// number of frames dropped because the queue was full
+	unsigned dropped() const;
+
+    private:
+	unsigned m_capacity;
+	std::vector<uint32_t> m_buffers;
+
+	// The positions are only incremented and each of them is written by one side only. The padding keeps them on
+	// separate cache lines.
+	std::atomic<unsigned> m_head;
+	char m_headPadding[64 - sizeof(std::atomic<unsigned>)];
+	std::atomic<unsigned> m_tail;
+	char m_tailPadding[64 - sizeof(std::atomic<unsigned>)];
+
+	std::atomic<unsigned> m_dropped;
+};
+
+#endif
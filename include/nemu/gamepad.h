@@ -1,21 +1,55 @@
 #ifndef NEMU_GAMEPAD_H_INCLUDED
 #define NEMU_GAMEPAD_H_INCLUDED
 
+#include <nemu/state.h>
+
 #include <lib6502/memory.h>
 
+#include <atomic>
+#include <functional>
+
 class GamePad : public lib6502::Memory
 {
     public:
+	/// buttons in the order the controller shifts them out
+	enum Button
+	{
+	    A,
+	    B,
+	    SELECT,
+	    START,
+	    UP,
+	    DOWN,
+	    LEFT,
+	    RIGHT
+	};
+
 	GamePad();
-	~GamePad();
 
-	void pollEvents();
+	/// sets the state of a button, may be called from any thread
+	void setButton(Button button, bool pressed);
+
+	/// returns the state of all buttons, one bit per button
+	uint8_t buttons() const;
+
+	/// Replaces the live button states the game reads with the ones returned by the callback (movie playback),
+	/// an empty callback switches back to the live states.
+	void setInputCallback(const std::function<uint8_t()>& inputCallback);
+
+	/// saves the state of the shift register, the live button states are not part of the machine state
+	void saveState(StateWriter& writer) const;
+	void loadState(StateReader& reader);
 
 	uint8_t read(uint16_t address) override;
 	void write(uint16_t address, uint8_t data) override;
 
     private:
-	uint8_t* m_data;
+	/// button states published by the input thread
+	std::atomic<uint8_t> m_buttons;
+	std::function<uint8_t()> m_inputCallback;
+
+	/// button states latched at the end of the strobe
+	uint8_t m_latched;
 	unsigned m_position;
 
 	bool m_resetInProgress;
@@ -2,20 +2,59 @@
 #define NEMU_LOADER_H_INCLUDED
 
 #include <nemu/memory/rom.h>
+#include <nemu/memory/mappedfile.h>
+#include <nemu/ppu/mirroring.h>
 
 #include <memory>
+#include <stdexcept>
 
+class LoaderException : public std::runtime_error
+{
+    public:
+	LoaderException(const std::string& error)
+	    : runtime_error(error)
+	{}
+};
+
+/// Loads iNES and NES 2.0 images. The file is mapped read-only and the ROMs refer into the mapping, so the images are
+/// not copied and processes running the same file share its pages.
 class Loader
 {
     public:
+	Loader();
+
 	const std::shared_ptr<memory::ROM> rom() const;
 	const std::shared_ptr<memory::ROM> vrom() const;
 
-	bool load(const std::string& file);
+	/// iNES mapper number of the cartridge (up to 12 bits for NES 2.0 images)
+	unsigned mapper() const;
+
+	/// the name table arrangement wired on the board, mappers with a mirroring register select their own
+	Mirroring mirroring() const;
+
+	/// the 512 byte trainer to be loaded at $7000, nullptr if the image has none
+	const uint8_t* trainer() const;
+
+	/// CRC-32 of the PRG and CHR ROM contents (header and trainer excluded) identifying the game
+	uint32_t crc32() const;
+
+	/// true if the header was in the NES 2.0 format
+	bool isNes2() const;
+
+	/// maps and validates the image, throws LoaderException if it is not a valid iNES file
+	void load(const std::string& file);
 
     private:
+	std::shared_ptr<memory::MappedFile> m_file;
+
 	std::shared_ptr<memory::ROM> m_rom;
 	std::shared_ptr<memory::ROM> m_vrom;
+
+	unsigned m_mapper;
+	Mirroring m_mirroring;
+	const uint8_t* m_trainer;
+	uint32_t m_crc32;
+	bool m_nes2;
 };
 
 #endif
@@ -0,0 +1,62 @@
+#ifndef NEMU_MACHINE_H_INCLUDED
+#define NEMU_MACHINE_H_INCLUDED
+
+#include <nemu/loader.h>
+#include <nemu/apu.h>
+#include <nemu/ppu.h>
+#include <nemu/gamepad.h>
+#include <nemu/mapper/mapper.h>
+#include <nemu/memory/dispatcher.h>
+#include <nemu/memory/ram.h>
+
+#include <lib6502/cpu.h>
+
+#include <memory>
+#include <vector>
+
+/// One console: the CPU with its bus, the PPU, the APU, the cartridge and the controller. A machine keeps all of its
+/// state in its own members, so any number of them can run in one process on separate threads. The ROM images of a
+/// cartridge are read only and may be shared between machines. Video and audio output and input are left to the owner.
+class Machine
+{
+    public:
+	/// powers on the cartridge, throws MapperException if its mapper is not supported
+	Machine(const Loader& cartridge);
+
+	/// runs the CPU and the PPU until the PPU completes the current frame
+	void runFrame();
+
+	/// serialises the whole machine state into the buffer
+	void saveState(std::vector<uint8_t>& buffer) const;
+	/// restores a state written by saveState(), throws StateException if it does not fit the machine
+	void loadState(const std::vector<uint8_t>& buffer);
+
+	lib6502::Cpu& cpu();
+	memory::Dispatcher& bus();
+	PPU& ppu();
+	APU& apu();
+	const std::shared_ptr<GamePad>& gamepad() const;
+
+	/// the 2kB system RAM
+	const uint8_t* ram() const;
+
+	/// number of CPU cycles executed, the reference stays valid for observers of the running machine
+	const uint64_t& cycles() const;
+
+    private:
+	uint64_t m_cycles;
+	/// CPU cycles left in which the CPU is halted by a sprite DMA transfer
+	unsigned m_stallCycles;
+
+	memory::Dispatcher m_memory;
+	std::unique_ptr<lib6502::Cpu> m_cpu;
+
+	std::shared_ptr<memory::RAM> m_ram;
+
+	std::shared_ptr<PPU> m_ppu;
+	std::shared_ptr<APU> m_apu;
+	std::shared_ptr<Mapper> m_mapper;
+	std::shared_ptr<GamePad> m_gamepad;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef MAPPER_CNROM_H_INCLUDED
+#define MAPPER_CNROM_H_INCLUDED
+
+#include <nemu/mapper/mapper.h>
+
+/// Mapper 3, fixed PRG ROM and a switchable 8kB CHR bank.
+class CNROM : public Mapper
+{
+    public:
+	CNROM(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr);
+
+    protected:
+	void writeRegister(uint16_t address, uint8_t data) override;
+	void updateBanks() override;
+
+	void saveRegisters(StateWriter& writer) const override;
+	void loadRegisters(StateReader& reader) override;
+
+    private:
+	uint8_t m_chrBank;
+};
+
+#endif
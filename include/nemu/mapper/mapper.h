@@ -0,0 +1,85 @@
+#ifndef MAPPER_MAPPER_H_INCLUDED
+#define MAPPER_MAPPER_H_INCLUDED
+
+#include <nemu/state.h>
+#include <nemu/memory/dispatcher.h>
+#include <nemu/memory/rom.h>
+#include <nemu/memory/ram.h>
+#include <nemu/ppu/mirroring.h>
+
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+class PPU;
+
+class MapperException : public std::runtime_error
+{
+    public:
+	MapperException(const std::string& error)
+	    : runtime_error(error)
+	{}
+};
+
+/// The cartridge hardware. A mapper owns the $6000-$ffff region of the CPU bus (8kB of PRG RAM followed by the PRG ROM
+/// windows) and the pattern windows of the PPU. Banks are switched by re-pointing the pages of the windows into the
+/// loaded images, nothing is copied and no handler is registered again.
+class Mapper : public lib6502::Memory, public std::enable_shared_from_this<Mapper>
+{
+    public:
+	Mapper(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr);
+
+	/// creates the mapper with the given iNES number, throws MapperException if it is not supported
+	static std::shared_ptr<Mapper> create(unsigned number, const std::shared_ptr<memory::ROM>& prg,
+					      const std::shared_ptr<memory::ROM>& chr);
+
+	/// registers the mapper on the CPU bus and maps the power on banks
+	virtual void attach(memory::Dispatcher& bus, PPU& ppu);
+
+	/// sets the callback raising an IRQ on the CPU
+	void setIrqCallback(const std::function<void()>& irqCallback);
+
+	/// saves the PRG RAM and the registers
+	void saveState(StateWriter& writer) const;
+	/// restores a state saved by saveState() and maps the banks selected in it
+	void loadState(StateReader& reader);
+
+	/// reads of $6000-$ffff not mapped to memory
+	uint8_t read(uint16_t address) override;
+	/// writes to the PRG ROM windows are register writes
+	void write(uint16_t address, uint8_t data) override;
+
+    protected:
+	/// a write to the registers at $8000-$ffff
+	virtual void writeRegister(uint16_t address, uint8_t data) = 0;
+
+	/// maps the banks selected by the registers
+	virtual void updateBanks() = 0;
+
+	virtual void saveRegisters(StateWriter& writer) const = 0;
+	virtual void loadRegisters(StateReader& reader) = 0;
+
+	/// maps a bank of the given size (a multiple of 8kB) of the PRG ROM at $8000-$ffff, the bank wraps around
+	void mapPrg(uint16_t address, unsigned size, unsigned bank);
+	/// maps a bank of count kB of the pattern memory into the pattern windows starting at the given one
+	void mapChr(unsigned window, unsigned count, unsigned bank);
+	/// selects the arrangement of the name tables, cartridges with four-screen memory ignore it
+	void setMirroring(Mirroring mirroring);
+
+	/// number of PRG ROM banks of the given size
+	unsigned prgBanks(unsigned size) const;
+
+    protected:
+	std::shared_ptr<memory::ROM> m_prg;
+	std::shared_ptr<memory::ROM> m_chr;
+
+	std::function<void()> m_irqCallback;
+
+    private:
+	memory::Dispatcher* m_bus;
+	PPU* m_ppu;
+
+	std::shared_ptr<memory::RAM> m_prgRam;
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef MAPPER_MMC1_H_INCLUDED
+#define MAPPER_MMC1_H_INCLUDED
+
+#include <nemu/mapper/mapper.h>
+
+/// Mapper 1, registers loaded through a serial shift register, 16 or 32kB PRG banks and 4 or 8kB CHR banks.
+class MMC1 : public Mapper
+{
+    public:
+	MMC1(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr);
+
+    protected:
+	void writeRegister(uint16_t address, uint8_t data) override;
+	void updateBanks() override;
+
+	void saveRegisters(StateWriter& writer) const override;
+	void loadRegisters(StateReader& reader) override;
+
+    private:
+	/// the 5 bit shift register, the 1 shifted in first marks it full when it reaches bit 0
+	uint8_t m_shift;
+
+	uint8_t m_control;
+	uint8_t m_chrBank0;
+	uint8_t m_chrBank1;
+	uint8_t m_prgBank;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef MAPPER_MMC3_H_INCLUDED
+#define MAPPER_MMC3_H_INCLUDED
+
+#include <nemu/mapper/mapper.h>
+
+/// Mapper 4, 8kB PRG banks, 1 and 2kB CHR banks and an IRQ counter clocked once per scanline.
+class MMC3 : public Mapper
+{
+    public:
+	MMC3(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr);
+
+	void attach(memory::Dispatcher& bus, PPU& ppu) override;
+
+    protected:
+	void writeRegister(uint16_t address, uint8_t data) override;
+	void updateBanks() override;
+
+	void saveRegisters(StateWriter& writer) const override;
+	void loadRegisters(StateReader& reader) override;
+
+    private:
+	/// clocks the IRQ counter
+	void scanline();
+
+    private:
+	uint8_t m_bankSelect;
+	/// the bank registers R0-R7
+	uint8_t m_banks[8];
+	uint8_t m_mirroring;
+	uint8_t m_prgRamProtect;
+
+	uint8_t m_irqLatch;
+	uint8_t m_irqCounter;
+	bool m_irqReload;
+	bool m_irqEnabled;
+};
+
+#endif
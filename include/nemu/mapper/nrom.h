@@ -0,0 +1,20 @@
+#ifndef MAPPER_NROM_H_INCLUDED
+#define MAPPER_NROM_H_INCLUDED
+
+#include <nemu/mapper/mapper.h>
+
+/// Mapper 0, 16 or 32kB of PRG ROM and 8kB of CHR without bank switching.
+class NROM : public Mapper
+{
+    public:
+	NROM(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr);
+
+    protected:
+	void writeRegister(uint16_t address, uint8_t data) override;
+	void updateBanks() override;
+
+	void saveRegisters(StateWriter& writer) const override;
+	void loadRegisters(StateReader& reader) override;
+};
+
+#endif
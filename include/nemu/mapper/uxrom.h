@@ -0,0 +1,23 @@
+#ifndef MAPPER_UXROM_H_INCLUDED
+#define MAPPER_UXROM_H_INCLUDED
+
+#include <nemu/mapper/mapper.h>
+
+/// Mapper 2, a switchable 16kB PRG bank at $8000 and the last bank fixed at $c000.
+class UxROM : public Mapper
+{
+    public:
+	UxROM(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr);
+
+    protected:
+	void writeRegister(uint16_t address, uint8_t data) override;
+	void updateBanks() override;
+
+	void saveRegisters(StateWriter& writer) const override;
+	void loadRegisters(StateReader& reader) override;
+
+    private:
+	uint8_t m_prgBank;
+};
+
+#endif
@@ -27,12 +27,25 @@ class Dispatcher : public lib6502::Memory
 		uint16_t m_address;
 	};
 
+	Dispatcher();
+
 	void registerHandler(uint16_t address, const std::shared_ptr<lib6502::Memory>& handler);
 	void registerHandler(uint16_t address, uint16_t size, const std::shared_ptr<lib6502::Memory>& handler);
 
+	/// Points the pages of a 256 byte aligned region directly at the given memory, overriding the handlers registered
+	/// for it. Accesses of a direction without memory (nullptr) still go to the handlers. This is how banks are
+	/// switched, it costs one pointer store per page.
+	void mapPages(uint16_t address, unsigned size, const uint8_t* readData, uint8_t* writeData);
+
 	uint8_t read(uint16_t address) override;
 	void write(uint16_t address, uint8_t data) override;
 
+	/// reads directly mapped memory without side effects, addresses handled by I/O registers read as zero
+	uint8_t peek(uint16_t address) const;
+
+	/// the memory a 256 byte page is read from directly, nullptr if reads of the page go to the handlers
+	const uint8_t* readPage(unsigned page) const;
+
     private:
 	struct Handler
 	{
@@ -41,9 +54,21 @@ class Dispatcher : public lib6502::Memory
 	    std::shared_ptr<lib6502::Memory> m_handler;
 	};
 
+	/// rebuilds the page table entry of the given 256 byte page
+	void updatePage(unsigned page);
+
 	const Handler& findHandler(uint16_t address);
 
 	std::vector<Handler> m_handlers;
+
+	// Page table of the address space with 256 byte granularity. Pages fully covered by a plain RAM or ROM have a
+	// direct pointer to their backing store, everything else (I/O registers, partially covered pages) is resolved
+	// through the handlers overlapping the page.
+	const uint8_t* m_readPages[256];
+	uint8_t* m_writePages[256];
+	std::vector<unsigned> m_pageHandlers[256];
+	/// true for pages set by mapPages()
+	bool m_mappedPages[256];
 };
 
 }
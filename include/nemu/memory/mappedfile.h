@@ -0,0 +1,33 @@
+#ifndef NEMU_MEMORY_MAPPEDFILE_H_INCLUDED
+#define NEMU_MEMORY_MAPPEDFILE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace memory
+{
+
+/// A file mapped read-only into the address space. The pages are shared with the page cache, so processes mapping the
+/// same file share one copy of it and nothing is read before it is accessed.
+class MappedFile
+{
+    public:
+	/// maps the whole file, throws std::system_error if it can not be opened or mapped
+	MappedFile(const std::string& file);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const uint8_t* data() const;
+	size_t size() const;
+
+    private:
+	const uint8_t* m_data;
+	size_t m_size;
+};
+
+}
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef NEMU_MEMORY_RAM_H_INCLUDED
 #define NEMU_MEMORY_RAM_H_INCLUDED
 
+#include <nemu/state.h>
+
 #include <lib6502/memory.h>
 
 namespace memory
@@ -9,11 +11,18 @@ namespace memory
 class RAM : public lib6502::Memory
 {
     public:
+	/// the memory is zero filled, every power on starts from the same state
 	RAM(unsigned size);
 	~RAM();
 
 	unsigned size() const;
 
+	/// direct access to the backing store
+	uint8_t* data();
+
+	void saveState(StateWriter& writer) const;
+	void loadState(StateReader& reader);
+
 	uint8_t read(uint16_t address) override;
 	void write(uint16_t address, uint8_t data) override;
 
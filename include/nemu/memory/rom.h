@@ -3,23 +3,49 @@
 
 #include <lib6502/memory.h>
 
+#include <memory>
+#include <stdexcept>
+
 namespace memory
 {
 
 class ROM : public lib6502::Memory
 {
     public:
+	/// thrown when a ROM is written, the address is relative to the start of the ROM
+	class WriteException : public std::runtime_error
+	{
+	    public:
+		WriteException(uint16_t address)
+		    : runtime_error("trying to write ROM"),
+		      m_address(address)
+		{}
+
+		uint16_t getAddress() const
+		{ return m_address; }
+
+	    private:
+		uint16_t m_address;
+	};
+
+	/// takes ownership of a buffer allocated with new[]
 	ROM(uint8_t* data, unsigned size);
-	~ROM();
+	/// refers to data inside a backing store (e.g. a file mapping) that is kept alive as long as the ROM
+	ROM(const uint8_t* data, unsigned size, const std::shared_ptr<const void>& backing);
 
 	unsigned size() const;
 
+	/// direct access to the backing store
+	const uint8_t* data() const;
+
 	uint8_t read(uint16_t address) override;
 	void write(uint16_t address, uint8_t data) override;
 
     private:
-	uint8_t* m_data;
+	const uint8_t* m_data;
 	unsigned m_size;
+
+	std::shared_ptr<const void> m_backing;
 };
 
 }
@@ -0,0 +1,39 @@
+#ifndef NEMU_MOVIE_H_INCLUDED
+#define NEMU_MOVIE_H_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+/// The controller input of a run, one button byte per frame, keyed to the PPU frame count the recording started at and
+/// the CRC-32 of the ROM it was recorded on. Replaying the inputs from the same machine state reproduces the run
+/// exactly. Files store the inputs run-length encoded, held buttons and idle frames collapse into a few bytes.
+class Movie
+{
+    public:
+	Movie(uint32_t romCrc = 0, unsigned startFrame = 0);
+
+	uint32_t romCrc() const;
+	/// the frame count the first input belongs to
+	unsigned startFrame() const;
+	/// number of frames recorded
+	unsigned length() const;
+
+	/// stores the input of a frame, the inputs of later frames (recorded before rewinding or loading a state) are
+	/// dropped
+	void record(unsigned frame, uint8_t buttons);
+
+	/// returns the input of a frame, false if the frame is not part of the movie
+	bool input(unsigned frame, uint8_t& buttons) const;
+
+	void save(std::vector<uint8_t>& buffer) const;
+	/// throws StateException if the buffer is not a valid movie
+	void load(const std::vector<uint8_t>& buffer);
+
+    private:
+	uint32_t m_romCrc;
+	unsigned m_startFrame;
+
+	std::vector<uint8_t> m_inputs;
+};
+
+#endif
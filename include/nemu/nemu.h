@@ -1,10 +1,78 @@
 #ifndef NEMU_NEMU_H_INCLUDED
 #define NEMU_NEMU_H_INCLUDED
 
-class NesEmulator
+/*
+ * Embedding API of the emulator core (libnemu). Instances are independent of each other and may be stepped on
+ * different threads, a single instance must only be used by one thread at a time. Functions returning int return 0
+ * on success and -1 on failure, nemu_last_error() describes the failure.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct nemu_instance nemu_instance;
+
+/* controller buttons of the input byte */
+enum
 {
-    public:
-	void run();
+    NEMU_BUTTON_A = 0x01,
+    NEMU_BUTTON_B = 0x02,
+    NEMU_BUTTON_SELECT = 0x04,
+    NEMU_BUTTON_START = 0x08,
+    NEMU_BUTTON_UP = 0x10,
+    NEMU_BUTTON_DOWN = 0x20,
+    NEMU_BUTTON_LEFT = 0x40,
+    NEMU_BUTTON_RIGHT = 0x80
 };
 
+enum
+{
+    NEMU_FRAME_WIDTH = 256,
+    NEMU_FRAME_HEIGHT = 240,
+    NEMU_RAM_SIZE = 0x800
+};
+
+nemu_instance* nemu_create(void);
+void nemu_destroy(nemu_instance* instance);
+
+/* loads an iNES image and powers the console on */
+int nemu_load_rom(nemu_instance* instance, const char* file);
+/* powers the console off and on again */
+int nemu_reset(nemu_instance* instance);
+
+/* runs the given number of frames with the buttons held, only the last of them is rendered */
+int nemu_step(nemu_instance* instance, unsigned frames, uint8_t buttons);
+
+/*
+ * Steps count instances with their own input byte each on the threads of a shared pool, returns -1 if any of them
+ * failed. Batches submitted from several threads at once share the pool.
+ */
+int nemu_step_batch(nemu_instance* const* instances, const uint8_t* buttons, size_t count, unsigned frames);
+
+/*
+ * Read-only views into the instance, valid until its next step, reset or state load. The frame is 256x240 pixels as
+ * 0x00RRGGBB or as system palette colours 0-63.
+ */
+const uint32_t* nemu_frame_rgb(const nemu_instance* instance);
+const uint8_t* nemu_frame_indices(const nemu_instance* instance);
+const uint8_t* nemu_ram(const nemu_instance* instance);
+
+/* number of frames emulated since power on */
+unsigned nemu_frame_count(const nemu_instance* instance);
+
+/* the state is written to the buffer if it is large enough, the required size is stored in size either way */
+int nemu_save_state(nemu_instance* instance, void* buffer, size_t* size);
+int nemu_load_state(nemu_instance* instance, const void* buffer, size_t size);
+
+/* the error of the last failing call on the instance */
+const char* nemu_last_error(const nemu_instance* instance);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
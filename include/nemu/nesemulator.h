@@ -1,39 +1,145 @@
 #ifndef NEMU_NESEMULATOR_H_INCLUDED
 #define NEMU_NESEMULATOR_H_INCLUDED
 
-#include <nemu/ppu.h>
-#include <nemu/gamepad.h>
-#include <nemu/memory/dispatcher.h>
-
-#include <lib6502/cpu.h>
-#include <boost/date_time/posix_time/posix_time.hpp>
+#include <nemu/machine.h>
+#include <nemu/presenter.h>
+#include <nemu/audiooutput.h>
+#include <nemu/framepacer.h>
+#include <nemu/rewindbuffer.h>
+#include <nemu/movie.h>
+#include <nemu/cputrace.h>
+#include <nemu/videorecorder.h>
 
 #include <memory>
+#include <string>
+#include <vector>
 
 class NesEmulator
 {
     public:
+	enum
+	{
+	    AUTO_FRAME_SKIP = -1
+	};
+
 	NesEmulator();
 
 	int run(int argc, char** argv);
 
     private:
+	bool parseArguments(int argc, char** argv);
+
 	bool loadCartridge(const std::string& file);
 
+	/// Runs a frame and presents the frame the given number of frames ahead of it with the current input instead.
+	/// The machine is restored to the state after the first frame afterwards.
+	void runAheadFrame();
+
+	/// decides whether the next frame is emulated without rendering it
+	bool skipFrame();
+
 	/// called when the PPU finished rendering of a frame
 	void frameComplete();
 
+	/// prints the throughput of a headless run as JSON
+	void printStatistics();
+
+	bool saveStateFile(const std::string& file);
+	bool loadStateFile(const std::string& file);
+
+	/// starts recording or playing the movie given on the command line
+	bool startMovie();
+	/// Selects the input of the next frame, records it or takes it from the movie. Stops headless runs at the end of
+	/// the movie, interactive ones continue with the live input.
+	void updateMovieInput();
+	bool saveMovieFile(const std::string& file);
+
     private:
 	/// true while the mainloop of the emulator is running
 	bool m_running;
 
-	std::unique_ptr<lib6502::Cpu> m_cpu;
-	memory::Dispatcher m_memory;
+	std::string m_cartridge;
+
+	/// run without display and input, never sleep to keep the frame rate
+	bool m_headless;
+	/// stop after this many frames, 0 means unlimited
+	unsigned m_frameLimit;
+	/// stop after this many seconds, 0 means unlimited
+	double m_timeLimit;
+	/// number of threads rendering whole frames behind the emulation, 0 renders on the emulation thread
+	unsigned m_renderThreads;
+	/// emulation speed as a multiple of the real frame rate
+	double m_speed;
+	/// run as fast as possible
+	bool m_turbo;
+
+	/// number of frames skipped after each rendered one, AUTO_FRAME_SKIP skips while behind the schedule or faster
+	/// than the display
+	int m_frameSkip;
+	/// number of frames skipped in a row
+	unsigned m_skipped;
+	/// true while the current frame is emulated without rendering it
+	bool m_skipping;
+	/// monotonic time the last rendered frame was started at in nanoseconds
+	uint64_t m_lastRendered;
+
+	/// save state loaded before the first frame
+	std::string m_loadStateFile;
+	/// save state written when the emulator exits
+	std::string m_saveStateFile;
+	/// reused for saving and loading states to avoid allocations
+	std::vector<uint8_t> m_stateBuffer;
+
+	/// the input of every frame is recorded to this file when the emulator exits
+	std::string m_recordMovieFile;
+	/// the input of every frame is taken from this movie
+	std::string m_playMovieFile;
+	std::unique_ptr<Movie> m_movie;
+	/// the buttons the game reads during the current frame while a movie is recorded or played
+	uint8_t m_movieInput;
+
+	/// instructions are traced into this file
+	std::string m_traceFile;
+	/// size of the trace ring in instructions
+	unsigned m_traceRecords;
+	/// only instructions in this PC range are traced
+	uint16_t m_traceFirst;
+	uint16_t m_traceLast;
+	/// tracing starts when this address is executed, -1 traces from the start
+	int m_traceTrigger;
+	std::unique_ptr<CpuTrace> m_trace;
+
+	/// the frames are recorded into this video file
+	std::string m_videoFile;
+	std::unique_ptr<VideoRecorder> m_recorder;
+
+	/// number of frames to run ahead, 0 disables run-ahead
+	unsigned m_runAhead;
+	/// state of the real frame while running ahead
+	std::vector<uint8_t> m_runAheadState;
+
+	/// memory budget of the rewind buffer in MB, 0 disables rewinding
+	unsigned m_rewindBudget;
+	/// a state is captured for rewinding every this many frames
+	unsigned m_rewindInterval;
+	std::unique_ptr<RewindBuffer> m_rewind;
+	/// true while the rewind key is held
+	bool m_rewinding;
+
+	/// CRC-32 of the loaded ROM, movies are only played on the ROM they were recorded on
+	uint32_t m_romCrc;
+
+	/// frame count of the PPU when the emulation was started, limits and statistics are relative to it
+	unsigned m_firstFrame;
 
-	std::shared_ptr<PPU> m_ppu;
-	std::shared_ptr<GamePad> m_gamepad;
+	std::unique_ptr<Machine> m_machine;
+	std::unique_ptr<Presenter> m_presenter;
+	/// nullptr if the emulator is headless or no audio device is available
+	std::unique_ptr<AudioOutput> m_audio;
 
-	boost::posix_time::ptime m_lastFrameEnd;
+	FramePacer m_pacer;
+	/// monotonic time the emulation started at in nanoseconds
+	uint64_t m_startTime;
 };
 
 #endif
@@ -1,11 +1,14 @@
 #ifndef NEMU_PPU_H_INCLUDED
 #define NEMU_PPU_H_INCLUDED
 
+#include <nemu/state.h>
 #include <nemu/memory/rom.h>
 #include <nemu/memory/dispatcher.h>
 #include <nemu/ppu/palette.h>
-
-#include <SDL/SDL.h>
+#include <nemu/ppu/mirroring.h>
+#include <nemu/ppu/spritememory.h>
+#include <nemu/ppu/renderer.h>
+#include <nemu/ppu/framerenderer.h>
 
 #include <stdexcept>
 #include <functional>
@@ -37,23 +40,72 @@ class PPU : public lib6502::Memory
 	// status register bits
 	enum
 	{
-	    SPRITE0_HIT = 0x40,
+	    SPRITE_OVERFLOW = Renderer::SPRITE_OVERFLOW,
+	    SPRITE0_HIT = Renderer::SPRITE0_HIT,
 	    VBLANK = 0x80
 	};
 
 	PPU(const std::shared_ptr<memory::ROM>& vrom);
+	~PPU();
 
 	void tick();
 
-	const std::shared_ptr<memory::RAM>& spriteRam() const;
+	const std::shared_ptr<SpriteMemory>& spriteRam() const;
+
+	/// number of frames completed since power on
+	unsigned frameCount() const;
 
 	void setNmiCallback(const std::function<void()>& nmiCallback);
+	/// sets the callback receiving the 256x240 frame buffer each time a frame is complete
+	void setFrameCallback(const std::function<void(const uint32_t*)>& frameCallback);
+
+	/// Renders whole frames after they were emulated on the given number of worker threads by replaying the logged
+	/// writes of the frame, 0 renders each line as the PPU reaches its end. Has to be called between frames. Frames
+	/// rendered by the workers are passed to the frame callback one frame later.
+	void setRenderThreads(unsigned threads);
+
+	/// Frames emulated with the video output disabled are not rendered, only the sprite 0 hit and sprite overflow
+	/// flags are evaluated, and they are not passed to the frame callback. Has to be called between frames.
+	void setVideoOutput(bool enabled);
+
+	/// Also produces the system palette colour (0-63) of each pixel besides the RGB frame, readable with indexFrame().
+	/// Only supported without render threads.
+	void setIndexOutput(bool enabled);
+
+	/// The RGB pixels of the last completed frame, valid until the next frame starts rendering. Only complete without
+	/// render threads, their frames are passed to the frame callback.
+	const uint32_t* frameBuffer() const;
+	/// the 256x240 system palette colours of the last completed frame, nullptr unless enabled with setIndexOutput()
+	const uint8_t* indexFrame() const;
+
+	/// sets the callback called at the end of each visible line while rendering is enabled (cartridge IRQ counters)
+	void setScanlineCallback(const std::function<void()>& scanlineCallback);
+
+	/// Switches the 1kB bank of the pattern memory (video ROM or the pattern RAM if there is none) seen in a 1kB window
+	/// of the pattern space. Only pointers are updated, the bank number wraps around the size of the memory.
+	void setPatternBank(unsigned window, unsigned bank);
+
+	/// Arranges the name table slots in CIRAM. Cartridges with four-screen memory keep their arrangement, the
+	/// mirroring selected by their mapper is ignored.
+	void setMirroring(Mirroring mirroring);
+	/// Points a name table slot (0-3) and its mirror at $3000-$3eff at a 1kB page of CIRAM (0-3). Only pointers are
+	/// updated.
+	void setNameTableBank(unsigned slot, unsigned bank);
 
 	uint8_t read(uint16_t address) override;
 	void write(uint16_t address, uint8_t data) override;
 
+	/// saves the registers, counters and video memory (except video ROM)
+	void saveState(StateWriter& writer) const;
+	/// restores a state saved by saveState(), the next frame is rendered from the restored state
+	void loadState(StateReader& reader);
+
+	/// renders the background of a line into the line buffer
 	void renderScanLine(unsigned line);
+	/// composites the sprites of a line over the background in the line buffer
 	void renderSpriteLine(unsigned line);
+	/// converts the line buffer to RGB pixels of the frame buffer
+	void outputScanLine(unsigned line);
 	void finishRendering();
 
     private:
@@ -66,7 +118,23 @@ class PPU : public lib6502::Memory
 
 	void incrementAddress();
 
+	/// updates the registers of the live render state and the renderer caches depending on the sprite memory
+	void syncRenderState();
+
+	/// updates the status register for a line without rendering it
+	void evaluateScanLine(unsigned line);
+
+	/// hands the log of the completed frame to the frame renderer and starts logging the next one
+	void finishDeferredFrame();
+	/// captures the state the current frame starts with and clears its render log
+	void beginFrameLog();
+
+	/// appends a write to the render log if frames are rendered by the frame renderer
+	void logWrite(RenderLogEntry::Type type, uint16_t address, uint8_t data);
+
     private:
+	std::shared_ptr<memory::ROM> m_vrom;
+
 	uint8_t m_ctrl;
 	uint8_t m_mask;
 
@@ -83,19 +151,40 @@ class PPU : public lib6502::Memory
 
 	unsigned m_tickCounter;
 	unsigned m_currentScanLine;
-
-	SDL_Surface* m_screen;
+	unsigned m_frameCount;
 
 	std::function<void()> m_nmiCallback;
+	std::function<void(const uint32_t*)> m_frameCallback;
+	std::function<void()> m_scanlineCallback;
+
+	bool m_videoOutput;
 
 	memory::Dispatcher m_memory;
-	std::shared_ptr<memory::RAM> m_nameTables[4];
+	/// pattern memory of cartridges without video ROM
+	std::shared_ptr<memory::RAM> m_patternRam;
+	/// name table memory, the 2kB of the console followed by the 2kB of cartridges with four-screen memory
+	std::shared_ptr<memory::RAM> m_ciram;
+	/// the CIRAM page each name table slot refers to
+	unsigned m_nameTableBanks[4];
+	bool m_fourScreen;
 	std::shared_ptr<PaletteMemory> m_palette;
-	std::shared_ptr<memory::RAM> m_sprite;
-
-	unsigned m_scanLineData[256];
-
-	static uint32_t s_rgbPalette[64];
+	std::shared_ptr<SpriteMemory> m_sprite;
+
+	/// the live state for the renderer
+	RenderState m_state;
+	Renderer m_renderer;
+
+	uint32_t m_frameBuffer[256 * 240];
+	std::unique_ptr<uint8_t[]> m_indexFrame;
+
+	// deferred rendering, the frame being emulated and the one being rendered use a separate set of buffers
+	std::unique_ptr<FrameRenderer> m_frameRenderer;
+	unsigned m_currentFrame;
+	/// true if the frame renderer was given a frame that was not passed to the frame callback yet
+	bool m_framePending;
+	RenderSnapshot m_frameStarts[2];
+	std::vector<RenderLogEntry> m_renderLogs[2];
+	std::unique_ptr<uint32_t[]> m_deferredFrames;
 };
 
 #endif
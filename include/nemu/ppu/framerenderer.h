@@ -0,0 +1,131 @@
+#ifndef PPU_FRAMERENDERER_H_INCLUDED
+#define PPU_FRAMERENDERER_H_INCLUDED
+
+#include <nemu/ppu/renderer.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A write changing the render state, timestamped with the PPU dot (scanline * 341 + tick) it happened on.
+struct RenderLogEntry
+{
+    enum Type
+    {
+	CTRL,
+	MASK,
+	SCROLL_X,
+	SCROLL_Y,
+	/// a PPUDATA write to pattern, name table or palette memory
+	VRAM,
+	OAM,
+	/// the address is the pattern window and the data the 1kB bank switched into it
+	PATTERN_BANK,
+	/// the address is the name table slot and the data the CIRAM page it refers to
+	NAME_TABLE_BANK
+    };
+
+    uint32_t m_dot;
+    uint16_t m_address;
+    uint8_t m_type;
+    uint8_t m_data;
+};
+
+/// A private copy of the video memory the log of a frame can be replayed on. Pattern memory is only copied if it is
+/// writable, video ROM is shared with the live state.
+class RenderSnapshot
+{
+    public:
+	RenderSnapshot();
+
+	/// Copies the live state. The name tables of the live state point into the 4kB of CIRAM. The pattern memory the
+	/// banks are switched from is either video ROM or the writable pattern memory of the PPU, the ROM is not copied.
+	void capture(const RenderState& live, const uint8_t* ciram, const uint8_t* patternRam, unsigned patternRamSize,
+		     const uint8_t* patternRom, unsigned patternRomSize);
+	void copyFrom(const RenderSnapshot& other);
+
+	/// applies a logged write and invalidates the caches of the renderer it affects
+	void apply(const RenderLogEntry& entry, Renderer& renderer);
+
+	/// true if the snapshot has writable pattern memory
+	bool hasPatternRam() const;
+
+	const RenderState& state() const;
+
+    private:
+	void updateState();
+
+    private:
+	RenderState m_state;
+
+	uint8_t m_ciram[4][0x400];
+	/// the CIRAM page each of the four name table slots refers to
+	unsigned m_nameTableBanks[4];
+
+	uint8_t m_palette[0x20];
+	uint8_t m_oam[0x100];
+
+	uint8_t m_patternRam[0x2000];
+	unsigned m_patternRamSize;
+	const uint8_t* m_patternRom;
+	unsigned m_patternRomSize;
+
+	/// true for pattern windows in the copied pattern RAM
+	bool m_ramPatterns[8];
+	/// offset of the pattern windows in the copied pattern RAM
+	unsigned m_ramPatternOffsets[8];
+	/// pattern windows in video ROM
+	const uint8_t* m_romPatterns[8];
+};
+
+/// Renders the visible lines of a frame on worker threads by replaying the render log of the frame on the state the
+/// frame started with. Each worker renders its own range of lines.
+class FrameRenderer
+{
+    public:
+	FrameRenderer(unsigned threads);
+	~FrameRenderer();
+
+	/// Starts rendering a frame into the 256x240 output buffer. The arguments have to stay untouched until wait()
+	/// returned.
+	void render(const RenderSnapshot& frameStart, const std::vector<RenderLogEntry>& log, uint32_t* output);
+
+	/// waits until the frame started by the last render() call is complete
+	void wait();
+
+    private:
+	struct Worker
+	{
+	    std::thread m_thread;
+
+	    unsigned m_firstLine;
+	    unsigned m_lastLine;
+
+	    RenderSnapshot m_snapshot;
+	    Renderer m_renderer;
+	};
+
+	void work(Worker& worker);
+	void renderLines(Worker& worker);
+
+    private:
+	std::vector<std::unique_ptr<Worker>> m_workers;
+
+	std::mutex m_mutex;
+	std::condition_variable m_startCond;
+	std::condition_variable m_doneCond;
+
+	/// incremented for each frame to render
+	unsigned m_generation;
+	/// number of workers still rendering the current frame
+	unsigned m_pending;
+	bool m_stop;
+
+	const RenderSnapshot* m_frameStart;
+	const std::vector<RenderLogEntry>* m_log;
+	uint32_t* m_output;
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef PPU_MIRRORING_H_INCLUDED
+#define PPU_MIRRORING_H_INCLUDED
+
+/// Arrangement of the four name table slots ($2000, $2400, $2800, $2c00) in the 2kB CIRAM of the console, or in 4kB
+/// if the cartridge provides the other two tables.
+enum Mirroring
+{
+    /// $2000 = $2400 and $2800 = $2c00, for vertical scrolling
+    MIRROR_HORIZONTAL,
+    /// $2000 = $2800 and $2400 = $2c00, for horizontal scrolling
+    MIRROR_VERTICAL,
+    /// all slots show the first table
+    MIRROR_SINGLE_LOW,
+    /// all slots show the second table
+    MIRROR_SINGLE_HIGH,
+    /// four separate tables
+    MIRROR_FOUR_SCREEN
+};
+
+#endif
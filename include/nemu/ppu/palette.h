@@ -8,6 +8,9 @@ class PaletteMemory : public memory::RAM
     public:
 	PaletteMemory();
 
+	/// maps the mirrored background colour entries of the sprite palettes to their real location
+	static uint16_t translateAddress(uint16_t address);
+
 	uint8_t read(uint16_t address) override;
 	void write(uint16_t address, uint8_t data) override;
 };
@@ -0,0 +1,41 @@
+#ifndef PPU_PIXELCONVERTER_H_INCLUDED
+#define PPU_PIXELCONVERTER_H_INCLUDED
+
+#include <cstdint>
+
+/// Converts palette indices (0..31) to 32 bit pixels through a resolved table of the 32 palette colours. The fastest
+/// implementation supported by the CPU is selected at runtime, all of them produce the same output.
+class PixelConverter
+{
+    public:
+	enum Implementation
+	{
+	    SCALAR,
+	    SSSE3,
+	    AVX2
+	};
+
+	/// selects the best implementation available
+	PixelConverter();
+	/// forces the given implementation, it has to be supported by the CPU
+	PixelConverter(Implementation implementation);
+
+	Implementation implementation() const;
+
+	static bool isSupported(Implementation implementation);
+
+	/// converts count indices to pixels using the given 32 entry colour table
+	void convert(const uint8_t* indices, uint32_t* pixels, unsigned count, const uint32_t* colors) const
+	{ m_convert(indices, pixels, count, colors); }
+
+    private:
+	typedef void (*ConvertFunction)(const uint8_t* indices, uint32_t* pixels, unsigned count, const uint32_t* colors);
+
+	void select(Implementation implementation);
+
+    private:
+	Implementation m_implementation;
+	ConvertFunction m_convert;
+};
+
+#endif
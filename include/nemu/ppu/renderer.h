@@ -0,0 +1,104 @@
+#ifndef PPU_RENDERER_H_INCLUDED
+#define PPU_RENDERER_H_INCLUDED
+
+#include <nemu/ppu/tilecache.h>
+#include <nemu/ppu/pixelconverter.h>
+
+#include <cstdint>
+
+/// The PPU state the renderer reads. The pointers refer to either the live video memory of the PPU or to a snapshot
+/// of it.
+struct RenderState
+{
+    uint8_t m_ctrl;
+    uint8_t m_mask;
+    uint8_t m_scrollX;
+    uint8_t m_scrollY;
+
+    /// the four 1kB name tables (including the attribute tables)
+    const uint8_t* m_nameTables[4];
+    /// 1kB windows of the $0000-$1fff pattern space
+    const uint8_t* m_patterns[8];
+    /// the 32 bytes of palette memory, the mirrored entries are not used
+    const uint8_t* m_palette;
+    /// the 256 bytes of sprite memory
+    const uint8_t* m_oam;
+};
+
+/// Renders visible lines (0..239) from a RenderState. The caches of the renderer (decoded tiles, per line sprite lists
+/// and resolved colours) have to be invalidated by the owner when the memory behind the state changes.
+class Renderer
+{
+    public:
+	// status register bits caused by rendering
+	enum
+	{
+	    SPRITE_OVERFLOW = 0x20,
+	    SPRITE0_HIT = 0x40
+	};
+
+	Renderer();
+
+	/// decodes all tiles of the pattern memory of the state
+	void rebuildTiles(const RenderState& state);
+
+	/// the given byte of pattern memory was written, every window of the state it is visible in is invalidated
+	void invalidatePattern(const RenderState& state, const uint8_t* data);
+	/// the whole pattern memory was changed
+	void invalidatePatterns();
+	/// the sprite memory was changed
+	void invalidateSprites();
+	/// the palette memory was changed
+	void invalidatePalette();
+
+	/// renders the background of a line into the line buffer
+	void renderBackground(const RenderState& state, unsigned line);
+	/// composites the sprites of a line over the background in the line buffer, returns the status bits caused
+	uint8_t renderSprites(const RenderState& state, unsigned line);
+	/// converts the line buffer to RGB pixels
+	void output(const RenderState& state, uint32_t* pixels);
+	/// converts the line buffer to the 6 bit system palette colours (0-63) the pixels have
+	void outputIndices(const RenderState& state, uint8_t* indices);
+
+	/// renders a complete line and returns the status bits caused
+	uint8_t renderLine(const RenderState& state, unsigned line, uint32_t* pixels);
+	/// returns the status bits a line would cause without producing its pixels
+	uint8_t evaluateStatus(const RenderState& state, unsigned line);
+
+	/// the 0xRRGGBB colour of a system palette colour (0-63)
+	static uint32_t rgbColor(unsigned index)
+	{ return s_rgbPalette[index & 0x3f]; }
+
+    private:
+	void syncPatterns(const RenderState& state);
+
+	/// builds the per line sprite lists from the sprite memory
+	void evaluateSprites(const RenderState& state);
+
+	/// resolves the 32 palette entries to RGB colours if the palette changed
+	void updateColors(const RenderState& state);
+
+    private:
+	TileCache m_tileCache;
+
+	bool m_spritesChanged;
+	/// the first 8 sprites (OAM indices) visible on each line, in priority order
+	uint8_t m_lineSprites[240][8];
+	uint8_t m_lineSpriteCount[240];
+	/// true for lines with more than 8 sprites
+	bool m_lineOverflow[240];
+
+	PixelConverter m_pixelConverter;
+	bool m_colorsChanged;
+	/// RGB colours of the palette entries
+	uint32_t m_colors[32];
+	/// system palette colours of the palette entries
+	uint8_t m_colorIndices[32];
+
+	/// palette indices of the line being rendered
+	uint8_t m_lineBuffer[256];
+
+	static const uint32_t s_rgbPalette[64];
+};
+
+#endif
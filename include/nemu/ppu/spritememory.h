@@ -0,0 +1,40 @@
+#ifndef PPU_SPRITEMEMORY_H_INCLUDED
+#define PPU_SPRITEMEMORY_H_INCLUDED
+
+#include <nemu/memory/ram.h>
+
+#include <functional>
+
+/// The 256 byte object attribute memory (OAM) of the PPU. It remembers whether it was written since the sprites were
+/// last evaluated.
+class SpriteMemory : public memory::RAM
+{
+    public:
+	enum
+	{
+	    SPRITES = 64
+	};
+
+	SpriteMemory();
+
+	/// true if the memory was written since the last call to clearChanged()
+	bool changed() const;
+	void clearChanged();
+	/// has to be called after the contents were modified through data()
+	void markChanged();
+
+	/// sets a callback called for every byte written through write()
+	void setWriteCallback(const std::function<void(uint16_t, uint8_t)>& writeCallback);
+
+	void write(uint16_t address, uint8_t data) override;
+
+	/// replaces the whole memory with the 256 bytes at data, the write callback is called for every byte
+	void load(const uint8_t* data);
+
+    private:
+	bool m_changed;
+
+	std::function<void(uint16_t, uint8_t)> m_writeCallback;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef PPU_TILECACHE_H_INCLUDED
+#define PPU_TILECACHE_H_INCLUDED
+
+#include <cstdint>
+
+/// Cache of the 512 tiles of the two pattern tables decoded from the 2 bitplane CHR format to one pixel index (0..3)
+/// per byte, both as stored and flipped horizontally. Tiles are decoded again lazily after they were invalidated.
+class TileCache
+{
+    public:
+	enum
+	{
+	    TILES = 512,
+	    WINDOW_SIZE = 0x400,
+	    TILES_PER_WINDOW = WINDOW_SIZE / 16
+	};
+
+	TileCache();
+
+	/// sets the 1kB pattern memory the given window (0..7) of the $0000-$1fff pattern space is decoded from
+	void setWindow(unsigned window, const uint8_t* data);
+
+	/// decodes every tile of the current windows
+	void rebuild();
+
+	/// marks the tile containing the given pattern space address as changed
+	void invalidate(uint16_t address);
+
+	/// returns the 8 pixel indices of a row of a tile
+	const uint8_t* row(unsigned tile, unsigned row)
+	{
+	    if (!m_valid[tile])
+		decode(tile);
+	    return m_tiles[tile][row];
+	}
+
+	/// returns the 8 pixel indices of a row of a horizontally flipped tile
+	const uint8_t* flippedRow(unsigned tile, unsigned row)
+	{
+	    if (!m_valid[tile])
+		decode(tile);
+	    return m_flippedTiles[tile][row];
+	}
+
+    private:
+	void decode(unsigned tile);
+
+    private:
+	const uint8_t* m_windows[8];
+
+	bool m_valid[TILES];
+
+	uint8_t m_tiles[TILES][8][8];
+	uint8_t m_flippedTiles[TILES][8][8];
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef NEMU_PRESENTER_H_INCLUDED
+#define NEMU_PRESENTER_H_INCLUDED
+
+#include <nemu/framequeue.h>
+#include <nemu/gamepad.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+/// Owns the SDL window on a thread of its own. Frames submitted by the emulation thread are queued and presented by
+/// the presenter thread, which also pumps the SDL events and publishes the input through the gamepad and atomics.
+class Presenter
+{
+    public:
+	/// hotkeys handled by the emulation thread
+	enum Hotkey
+	{
+	    SAVE_STATE = 0x01,
+	    LOAD_STATE = 0x02
+	};
+
+	Presenter(const std::shared_ptr<GamePad>& gamepad);
+	~Presenter();
+
+	/// queues a frame for presentation, never blocks (emulation thread only)
+	void submit(const uint32_t* frame);
+
+	/// true after the window was closed or escape was pressed
+	bool quitRequested() const;
+	/// true while the fast forward key (tab) is held
+	bool turboRequested() const;
+	/// true while the rewind key (backspace) is held
+	bool rewindRequested() const;
+
+	/// returns the hotkeys pressed since the last call
+	unsigned takeHotkeys();
+
+	/// number of frames dropped because the presenter fell behind
+	unsigned droppedFrames() const;
+
+    private:
+	void run();
+
+	void pollEvents();
+	void handleKey(int key, bool pressed);
+
+    private:
+	std::shared_ptr<GamePad> m_gamepad;
+
+	FrameQueue m_frames;
+
+	std::atomic<bool> m_stop;
+	std::atomic<bool> m_quitRequested;
+	std::atomic<bool> m_turboRequested;
+	std::atomic<bool> m_rewindRequested;
+	std::atomic<unsigned> m_hotkeys;
+
+	std::thread m_thread;
+};
+
+#endif
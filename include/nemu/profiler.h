@@ -0,0 +1,152 @@
+#ifndef NEMU_PROFILER_H_INCLUDED
+#define NEMU_PROFILER_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+/// Frame time instrumentation, compiled in with NEMU_PROFILE defined (scons profile=1). The wall time spent in each
+/// section is summed per emulated frame and the per frame sums are collected in histograms, dumped to stderr on exit
+/// and on SIGUSR1. Without NEMU_PROFILE the macros expand to nothing.
+namespace profile
+{
+
+enum Section
+{
+    CPU,
+    /// PPU::tick() without the rendering it triggers
+    PPU_TICK,
+    RENDER_BACKGROUND,
+    RENDER_SPRITES,
+    OUTPUT_LINE,
+    SPRITE_DMA,
+    /// catching up the APU channels and synthesizing their output
+    APU,
+    FINISH_FRAME,
+    /// converting and flipping a frame on the presenter thread
+    PRESENT,
+    /// SDL event polling on the presenter thread
+    INPUT,
+    PACING,
+
+    SECTION_COUNT
+};
+
+/// The CPU and PPU ticks are too short to time each of them, one in this many is timed and weighted accordingly. A
+/// single tick takes less than reading the clock, their estimate relies on subtracting the calibrated timer overhead.
+static const unsigned SAMPLE_INTERVAL = 64;
+
+/// Log-linear histogram of nanosecond values, each power of two is split into 16 buckets so any percentile is within
+/// about 6% of the real value.
+class Histogram
+{
+    public:
+	Histogram();
+
+	void record(uint64_t value);
+
+	uint64_t count() const;
+	uint64_t max() const;
+	double mean() const;
+	/// the value below which the given fraction of the recorded values are
+	uint64_t percentile(double fraction) const;
+
+    private:
+	static unsigned bucket(uint64_t value);
+	/// the smallest value of a bucket
+	static uint64_t bucketValue(unsigned bucket);
+
+    private:
+	static const unsigned SUB_BUCKETS = 16;
+	static const unsigned BUCKETS = SUB_BUCKETS + (64 - 4) * SUB_BUCKETS;
+
+	uint64_t m_counts[BUCKETS];
+	uint64_t m_count;
+	uint64_t m_sum;
+	uint64_t m_max;
+};
+
+class Profiler
+{
+    public:
+	static Profiler& instance();
+
+	/// adds time to the section in the current frame, may be called from any thread
+	void add(Section section, uint64_t nanoseconds);
+
+	/// closes the current frame, its section sums are recorded into the histograms
+	void endFrame();
+
+	/// true once after SIGUSR1 was received
+	bool dumpRequested();
+	void dump(std::ostream& stream) const;
+
+	/// the time reading the clock twice takes, it is subtracted from every timed section
+	uint64_t timerOverhead() const;
+
+	/// monotonic time in nanoseconds
+	static uint64_t now();
+
+    private:
+	Profiler();
+
+	static void handleSignal(int signal);
+
+    private:
+	std::atomic<uint64_t> m_frameSums[SECTION_COUNT];
+
+	Histogram m_histograms[SECTION_COUNT];
+	/// wall time between the ends of two frames
+	Histogram m_frameTimes;
+	uint64_t m_frameStart;
+
+	uint64_t m_timerOverhead;
+
+	static std::atomic<bool> s_dumpRequested;
+};
+
+/// Times the scope it lives in. Time spent in nested timers of the same thread is only accounted to the innermost one.
+class ScopedTimer
+{
+    public:
+	ScopedTimer(Section section, unsigned weight = 1);
+	~ScopedTimer();
+
+    private:
+	Section m_section;
+	unsigned m_weight;
+
+	uint64_t m_start;
+	/// time spent in nested timers
+	uint64_t m_nested;
+	ScopedTimer* m_parent;
+
+	static thread_local ScopedTimer* s_current;
+};
+
+}
+
+#ifdef NEMU_PROFILE
+#define NEMU_PROFILE_CONCAT2(a, b) a##b
+#define NEMU_PROFILE_CONCAT(a, b) NEMU_PROFILE_CONCAT2(a, b)
+/// times the rest of the enclosing scope as the given section
+#define NEMU_PROFILE_SCOPE(section) \
+    profile::ScopedTimer NEMU_PROFILE_CONCAT(profileTimer, __LINE__)(profile::section)
+/// closes the frame and dumps the histograms if a dump was requested with SIGUSR1
+#define NEMU_PROFILE_END_FRAME() \
+    do \
+    { \
+	profile::Profiler& profiler = profile::Profiler::instance(); \
+	profiler.endFrame(); \
+	if (profiler.dumpRequested()) \
+	    profiler.dump(std::cerr); \
+    } \
+    while (0)
+#define NEMU_PROFILE_DUMP() profile::Profiler::instance().dump(std::cerr)
+#else
+#define NEMU_PROFILE_SCOPE(section)
+#define NEMU_PROFILE_END_FRAME()
+#define NEMU_PROFILE_DUMP()
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef NEMU_REWINDBUFFER_H_INCLUDED
+#define NEMU_REWINDBUFFER_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/// History of save states for rewinding. Every state is stored as the run-length encoded XOR delta against the last
+/// keyframe, most of a state does not change between frames so the deltas are mostly zero runs. Keyframes are the
+/// encoded XOR against zero. The oldest states are dropped to stay within the memory budget.
+class RewindBuffer
+{
+    public:
+	/// budget is in bytes, a keyframe is stored every keyframeInterval states
+	RewindBuffer(size_t budget, unsigned keyframeInterval);
+
+	void push(const std::vector<uint8_t>& state);
+
+	/// removes the newest state and stores it into state, returns false if the buffer is empty
+	bool pop(std::vector<uint8_t>& state);
+
+	/// number of states stored
+	size_t size() const;
+	/// bytes used by the encoded states
+	size_t usedBytes() const;
+
+    private:
+	struct Entry
+	{
+	    bool m_keyframe;
+	    /// size of the decoded state
+	    size_t m_size;
+	    std::vector<uint8_t> m_data;
+	};
+
+	/// drops the oldest keyframe and the deltas depending on it
+	void dropOldest();
+
+	/// restores m_keyframe from the newest keyframe entry
+	void decodeKeyframe();
+
+	static void encode(const uint8_t* state, const uint8_t* reference, size_t size, std::vector<uint8_t>& output);
+	static void decode(const std::vector<uint8_t>& input, const uint8_t* reference, uint8_t* state, size_t size);
+
+    private:
+	size_t m_budget;
+	unsigned m_keyframeInterval;
+
+	std::deque<Entry> m_entries;
+	size_t m_usedBytes;
+
+	/// number of states pushed since the newest keyframe
+	unsigned m_sinceKeyframe;
+	/// the decoded newest keyframe the deltas are computed against, empty if there is none
+	std::vector<uint8_t> m_keyframe;
+
+	/// buffer reused for encoding
+	std::vector<uint8_t> m_encoded;
+};
+
+#endif
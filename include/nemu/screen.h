@@ -0,0 +1,27 @@
+#ifndef NEMU_SCREEN_H_INCLUDED
+#define NEMU_SCREEN_H_INCLUDED
+
+#include <SDL/SDL.h>
+
+#include <cstdint>
+
+/// SDL window the emulated frames are presented in
+class Screen
+{
+    public:
+	enum
+	{
+	    WIDTH = 256,
+	    HEIGHT = 240
+	};
+
+	Screen();
+
+	/// copies a WIDTH x HEIGHT frame of 32 bit pixels to the window and flips it
+	void present(const uint32_t* frame);
+
+    private:
+	SDL_Surface* m_surface;
+};
+
+#endif
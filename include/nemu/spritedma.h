@@ -0,0 +1,32 @@
+#ifndef NEMU_SPRITEDMA_H_INCLUDED
+#define NEMU_SPRITEDMA_H_INCLUDED
+
+#include <nemu/memory/dispatcher.h>
+#include <nemu/ppu/spritememory.h>
+
+#include <functional>
+
+/// The $4014 OAM DMA register copying a page of CPU memory to the sprite RAM of the PPU. Pages of plain RAM or ROM are
+/// copied at once, only pages with I/O registers are read byte by byte. The CPU is halted during the transfer, the
+/// stall is reported to the owner of the CPU.
+class SpriteDMA : public lib6502::Memory
+{
+    public:
+	/// the cycle counter of the machine decides the length of the stall
+	SpriteDMA(memory::Dispatcher& memory, SpriteMemory& spriteRam, const uint64_t& cycles);
+
+	/// called with the number of CPU cycles the CPU has to be halted for after a transfer
+	void setStallCallback(const std::function<void(unsigned)>& stallCallback);
+
+	uint8_t read(uint16_t address) override;
+	void write(uint16_t address, uint8_t data) override;
+
+    private:
+	memory::Dispatcher& m_memory;
+	SpriteMemory& m_spriteRam;
+	const uint64_t& m_cycles;
+
+	std::function<void(unsigned)> m_stallCallback;
+};
+
+#endif
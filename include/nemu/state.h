@@ -0,0 +1,67 @@
+#ifndef NEMU_STATE_H_INCLUDED
+#define NEMU_STATE_H_INCLUDED
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+class StateException : public std::runtime_error
+{
+    public:
+	StateException(const std::string& error)
+	    : runtime_error(error)
+	{}
+};
+
+/// Serialises the machine state into a binary buffer. Values are stored in host byte order, states are meant to be
+/// loaded on the machine they were saved on.
+class StateWriter
+{
+    public:
+	StateWriter(std::vector<uint8_t>& buffer);
+
+	/// starts the section of a component, the tag is checked when the state is loaded
+	void beginSection(const char* tag);
+
+	void write(const void* data, size_t size);
+
+	template <typename T>
+	void write(const T& value)
+	{ write(&value, sizeof(value)); }
+
+    private:
+	std::vector<uint8_t>& m_buffer;
+};
+
+/// Reads a state written by StateWriter, throws StateException if the state is truncated or does not match.
+class StateReader
+{
+    public:
+	StateReader(const uint8_t* data, size_t size);
+
+	/// checks that the section of the given component follows
+	void beginSection(const char* tag);
+
+	void read(void* data, size_t size);
+
+	template <typename T>
+	T read()
+	{
+	    T value;
+	    read(&value, sizeof(value));
+	    return value;
+	}
+
+	/// true if the whole state was read
+	bool atEnd() const;
+
+    private:
+	const uint8_t* m_data;
+	size_t m_size;
+	size_t m_position;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef NEMU_VIDEORECORDER_H_INCLUDED
+#define NEMU_VIDEORECORDER_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// header of a video file, followed by the frames
+struct VideoHeader
+{
+    char m_magic[4];
+    uint32_t m_version;
+    uint16_t m_width;
+    uint16_t m_height;
+    /// frames per second as a fraction
+    uint32_t m_rateNumerator;
+    uint32_t m_rateDenominator;
+    /// the 0xRRGGBB colours of the system palette the pixels index
+    uint32_t m_palette[64];
+};
+
+/// precedes the payload of each frame
+struct VideoFrameHeader
+{
+    enum Type
+    {
+	/// the payload is the system palette colour (0-63) of every pixel
+	KEY = 0,
+	/// The payload is a sequence of runs against the previous frame of the file, each a varint number of unchanged
+	/// pixels, a varint number of changed pixels and their colours. Unchanged pixels at the end are not encoded.
+	DELTA = 1
+    };
+
+    /// Position of the frame in the recording, counted by the recorder as the PPU frame count jumps on state loads.
+    /// Gaps are frames dropped or skipped while recording.
+    uint32_t m_frame;
+    uint32_t m_type;
+    uint32_t m_size;
+};
+
+/// entry of the index file written next to the video, one per frame
+struct VideoIndexEntry
+{
+    uint32_t m_frame;
+    uint32_t m_type;
+    /// file offset of the frame header
+    uint64_t m_offset;
+};
+
+static_assert(sizeof(VideoIndexEntry) == 16, "the index file layout depends on the entry size");
+
+/// Records the system palette colours of the emulated frames. The emulation thread only copies each frame into a ring
+/// of preallocated buffers, a writer thread encodes them against the previous frame and writes the file and its index
+/// (the file name with ".idx" appended) in large sequential writes. A frame submitted while every buffer is in use is
+/// dropped instead of waiting for the disk. nemu-videofmt converts a recording to a Y4M stream.
+class VideoRecorder
+{
+    public:
+	static const char s_magic[4];
+	static const uint32_t s_version = 2;
+
+	enum
+	{
+	    WIDTH = 256,
+	    HEIGHT = 240,
+	    FRAME_SIZE = WIDTH * HEIGHT
+	};
+
+	/// creates the video and index files, throws std::system_error if they can not be created
+	VideoRecorder(const std::string& file);
+	/// finishes the recording if it was not finished yet and closes the files
+	~VideoRecorder();
+
+	VideoRecorder(const VideoRecorder&) = delete;
+	VideoRecorder& operator=(const VideoRecorder&) = delete;
+
+	/// Queues the next frame of 256x240 system palette colours, returns false if it was dropped (emulation thread
+	/// only).
+	bool submit(const uint8_t* frame);
+	/// the next frame was emulated without output, the converter repeats the frame before it (emulation thread only)
+	void skip();
+
+	/// writes the queued frames and stops the writer thread, no frames can be submitted afterwards
+	void finish();
+
+	/// number of frames written
+	uint64_t frames() const;
+	/// number of frames dropped because the writer fell behind
+	unsigned dropped() const;
+	/// the errno of the first failed write, the frames after it are discarded
+	int error() const;
+
+    private:
+	void run();
+
+	/// encodes a frame into the output buffer and appends its index entry
+	void encode(const uint8_t* frame, uint32_t frameNumber);
+	/// writes the buffered output to the files
+	void flush();
+
+	void writeAll(int fd, const void* data, size_t size);
+
+    private:
+	int m_fd;
+	int m_indexFd;
+
+	// the ring of frames, written by the emulation thread and read by the writer thread like the FrameQueue
+	unsigned m_capacity;
+	std::vector<uint8_t> m_buffers;
+	std::vector<uint32_t> m_frameNumbers;
+	std::atomic<unsigned> m_head;
+	char m_headPadding[64 - sizeof(std::atomic<unsigned>)];
+	std::atomic<unsigned> m_tail;
+	char m_tailPadding[64 - sizeof(std::atomic<unsigned>)];
+	std::atomic<unsigned> m_dropped;
+	/// position of the next frame in the recording (emulation thread only)
+	uint32_t m_sequence;
+
+	// writer thread only
+	std::vector<uint8_t> m_previous;
+	/// frames encoded since the last key frame
+	unsigned m_sinceKey;
+	std::vector<uint8_t> m_output;
+	std::vector<VideoIndexEntry> m_index;
+	/// file offset of the first byte of the output buffer
+	uint64_t m_offset;
+
+	std::atomic<uint64_t> m_frames;
+	std::atomic<int> m_error;
+
+	/// the writer sleeps on the condition until frames are queued, the emulation thread never takes the mutex
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::atomic<bool> m_stop;
+	std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef NEMU_WORKPOOL_H_INCLUDED
+#define NEMU_WORKPOOL_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Runs tasks on a fixed set of threads. Each worker has its own queue, it takes tasks from the back of it and steals
+/// from the front of the other queues once it runs dry, so tasks of very different length keep every worker busy
+/// without all of them contending for one central queue.
+class WorkPool
+{
+    public:
+	/// Counts the unfinished tasks submitted with it, so callers sharing the pool wait for their own tasks only. It
+	/// has to outlive its tasks.
+	class TaskGroup
+	{
+	    public:
+		TaskGroup()
+		    : m_pending(0)
+		{}
+
+	    private:
+		friend class WorkPool;
+
+		/// guarded by the mutex of the pool
+		unsigned m_pending;
+	};
+
+	/// 0 threads starts one per hardware thread
+	WorkPool(unsigned threads);
+	/// finishes the queued tasks before it returns
+	~WorkPool();
+
+	unsigned threads() const;
+
+	/// queues a task, tasks are spread over the workers round robin (may be called from several threads at once)
+	void submit(const std::function<void()>& task);
+	/// queues a task belonging to a group
+	void submit(TaskGroup& group, const std::function<void()>& task);
+
+	/// blocks until every submitted task is done
+	void wait();
+	/// blocks until the tasks of a group are done
+	void wait(TaskGroup& group);
+
+    private:
+	struct Task
+	{
+	    std::function<void()> m_function;
+	    /// nullptr for tasks submitted without a group
+	    TaskGroup* m_group;
+	};
+
+	struct Worker
+	{
+	    std::thread m_thread;
+
+	    std::mutex m_mutex;
+	    std::deque<Task> m_tasks;
+	};
+
+	void push(const std::function<void()>& task, TaskGroup* group);
+
+	void work(unsigned index);
+
+	/// takes a task from the own queue of a worker or steals one from the others
+	bool takeTask(unsigned index, Task& task);
+
+    private:
+	std::vector<std::unique_ptr<Worker>> m_workers;
+
+	std::mutex m_mutex;
+	std::condition_variable m_taskCond;
+	std::condition_variable m_doneCond;
+
+	/// tasks in the queues, a task is counted a moment before it is in its queue
+	int m_queued;
+	/// tasks submitted and not finished yet
+	unsigned m_pending;
+	/// incremented for each task, the worker the task is queued at is this modulo the number of workers
+	std::atomic<unsigned> m_next;
+	bool m_stop;
+};
+
+#endif
@@ -0,0 +1,913 @@
+#include <nemu/apu.h>
+#include <nemu/profiler.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <string.h>
+
+/// CPU cycles per second of the NTSC console
+static const double CLOCK_RATE = 1789773.0;
+static const double DEFAULT_SAMPLE_RATE = 48000.0;
+
+/// samples the synthesis can hold, a frame at the highest adjusted rate takes about 810
+static const unsigned SAMPLE_CAPACITY = 4096;
+
+static const uint8_t s_lengths[32] = {
+    10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14, 12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28,
+    32, 30
+};
+
+static const uint8_t s_duties[4][8] = {
+    {0, 1, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 0, 0, 0, 0, 0},
+    {0, 1, 1, 1, 1, 0, 0, 0},
+    {1, 0, 0, 1, 1, 1, 1, 1}
+};
+
+static const uint8_t s_triangle[32] = {
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+
+/// periods of the noise channel and the DMC in CPU cycles
+static const uint16_t s_noisePeriods[16] = {4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068};
+static const uint16_t s_dmcPeriods[16] = {428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54};
+
+/// cycles of the frame counter steps since the start of the sequence and the length of the sequence
+static const uint32_t s_frameSteps[2][4] = {
+    {7457, 14913, 22371, 29829},
+    {7457, 14913, 22371, 37281}
+};
+static const uint32_t s_framePeriods[2] = {29830, 37282};
+
+/// output of the non-linear mixer of the console for the sum of the pulse levels and the weighted sum of the others
+struct MixerTables
+{
+    MixerTables()
+    {
+	m_pulse[0] = 0.0f;
+	for (unsigned i = 1; i < 31; ++i)
+	    m_pulse[i] = 95.52 / (8128.0 / i + 100.0);
+
+	m_tnd[0] = 0.0f;
+	for (unsigned i = 1; i < 203; ++i)
+	    m_tnd[i] = 163.67 / (24329.0 / i + 100.0);
+    }
+
+    float m_pulse[31];
+    /// indexed by 3 * triangle + 2 * noise + DMC
+    float m_tnd[203];
+};
+
+// =====================================================================================================================
+/// Advances a channel timer by the given number of cycles, returns the number of times it expired.
+static uint64_t advanceTimer(uint32_t& counter, uint32_t period, uint64_t cycles)
+{
+    if (cycles < counter)
+    {
+	counter -= cycles;
+	return 0;
+    }
+
+    cycles -= counter;
+    counter = period - cycles % period;
+
+    return 1 + cycles / period;
+}
+
+// =====================================================================================================================
+APU::APU(memory::Dispatcher& memory, const uint64_t& cycles)
+    : m_memory(memory),
+      m_cycles(cycles),
+      m_time(cycles),
+      m_frameStart(cycles),
+      m_nextEvent(0),
+      m_fiveStep(false),
+      m_irqInhibit(false),
+      m_frameIrq(false),
+      m_dmcIrq(false),
+      m_frameStep(0),
+      m_frameCycle(0),
+      m_audioOutput(true),
+      m_mix(0.0f),
+      m_blip(SAMPLE_CAPACITY),
+      m_samples(SAMPLE_CAPACITY)
+{
+    memset(m_pulse, 0, sizeof(m_pulse));
+    memset(&m_triangle, 0, sizeof(m_triangle));
+    memset(&m_noise, 0, sizeof(m_noise));
+    memset(&m_dmc, 0, sizeof(m_dmc));
+    memset(m_levels, 0, sizeof(m_levels));
+
+    m_pulse[0].m_counter = 1;
+    m_pulse[1].m_counter = 1;
+    m_triangle.m_counter = 1;
+    m_noise.m_counter = 1;
+    m_noise.m_shift = 1;
+    m_dmc.m_counter = 1;
+    m_dmc.m_bits = 8;
+    m_dmc.m_silence = true;
+
+    m_blip.setRates(CLOCK_RATE, DEFAULT_SAMPLE_RATE);
+
+    updateNextEvent();
+}
+
+// =====================================================================================================================
+void APU::setIrqCallback(const std::function<void()>& irqCallback)
+{
+    m_irqCallback = irqCallback;
+}
+
+// =====================================================================================================================
+void APU::setSampleCallback(const std::function<void(const int16_t*, unsigned)>& sampleCallback)
+{
+    m_sampleCallback = sampleCallback;
+}
+
+// =====================================================================================================================
+void APU::setSampleRate(double sampleRate)
+{
+    m_blip.setRates(CLOCK_RATE, sampleRate);
+}
+
+// =====================================================================================================================
+void APU::setAudioOutput(bool enabled)
+{
+    m_audioOutput = enabled;
+}
+
+// =====================================================================================================================
+void APU::update()
+{
+    NEMU_PROFILE_SCOPE(APU);
+    run(m_cycles);
+}
+
+// =====================================================================================================================
+void APU::endFrame()
+{
+    NEMU_PROFILE_SCOPE(APU);
+    run(m_cycles);
+
+    if (m_audioOutput && m_sampleCallback)
+    {
+	m_blip.endFrame(m_time - m_frameStart);
+
+	unsigned count = m_blip.readSamples(m_samples.data(), m_samples.size());
+	m_sampleCallback(m_samples.data(), count);
+    }
+
+    m_frameStart = m_time;
+}
+
+// =====================================================================================================================
+template <typename T>
+static T readLimited(StateReader& reader, T limit)
+{
+    T value = reader.read<T>();
+
+    if (value > limit)
+	throw StateException("invalid APU state");
+
+    return value;
+}
+
+// =====================================================================================================================
+static uint32_t readCounter(StateReader& reader)
+{
+    uint32_t counter = reader.read<uint32_t>();
+
+    if (counter == 0)
+	throw StateException("invalid APU state");
+
+    return counter;
+}
+
+// =====================================================================================================================
+void APU::saveEnvelope(StateWriter& writer, const Envelope& envelope)
+{
+    writer.write(envelope.m_start);
+    writer.write(envelope.m_loop);
+    writer.write(envelope.m_constant);
+    writer.write(envelope.m_volume);
+    writer.write(envelope.m_divider);
+    writer.write(envelope.m_decay);
+}
+
+// =====================================================================================================================
+void APU::loadEnvelope(StateReader& reader, Envelope& envelope)
+{
+    envelope.m_start = reader.read<bool>();
+    envelope.m_loop = reader.read<bool>();
+    envelope.m_constant = reader.read<bool>();
+    // the volumes index the mixer tables
+    envelope.m_volume = readLimited<uint8_t>(reader, 15);
+    envelope.m_divider = readLimited<uint8_t>(reader, 15);
+    envelope.m_decay = readLimited<uint8_t>(reader, 15);
+}
+
+// =====================================================================================================================
+void APU::savePulse(StateWriter& writer, const Pulse& pulse)
+{
+    saveEnvelope(writer, pulse.m_envelope);
+    writer.write(pulse.m_enabled);
+    writer.write(pulse.m_duty);
+    writer.write(pulse.m_step);
+    writer.write(pulse.m_length);
+    writer.write(pulse.m_timer);
+    writer.write(pulse.m_counter);
+    writer.write(pulse.m_sweepEnabled);
+    writer.write(pulse.m_sweepNegate);
+    writer.write(pulse.m_sweepReload);
+    writer.write(pulse.m_sweepPeriod);
+    writer.write(pulse.m_sweepShift);
+    writer.write(pulse.m_sweepDivider);
+}
+
+// =====================================================================================================================
+void APU::loadPulse(StateReader& reader, Pulse& pulse)
+{
+    loadEnvelope(reader, pulse.m_envelope);
+    pulse.m_enabled = reader.read<bool>();
+    pulse.m_duty = readLimited<uint8_t>(reader, 3);
+    pulse.m_step = readLimited<uint8_t>(reader, 7);
+    pulse.m_length = reader.read<uint8_t>();
+    pulse.m_timer = readLimited<uint16_t>(reader, 0x7ff);
+    pulse.m_counter = readCounter(reader);
+    pulse.m_sweepEnabled = reader.read<bool>();
+    pulse.m_sweepNegate = reader.read<bool>();
+    pulse.m_sweepReload = reader.read<bool>();
+    pulse.m_sweepPeriod = readLimited<uint8_t>(reader, 7);
+    pulse.m_sweepShift = readLimited<uint8_t>(reader, 7);
+    pulse.m_sweepDivider = readLimited<uint8_t>(reader, 7);
+}
+
+// =====================================================================================================================
+void APU::saveState(StateWriter& writer) const
+{
+    writer.beginSection("APU ");
+
+    savePulse(writer, m_pulse[0]);
+    savePulse(writer, m_pulse[1]);
+
+    writer.write(m_triangle.m_enabled);
+    writer.write(m_triangle.m_control);
+    writer.write(m_triangle.m_linearReload);
+    writer.write(m_triangle.m_linearPeriod);
+    writer.write(m_triangle.m_linear);
+    writer.write(m_triangle.m_length);
+    writer.write(m_triangle.m_step);
+    writer.write(m_triangle.m_timer);
+    writer.write(m_triangle.m_counter);
+
+    saveEnvelope(writer, m_noise.m_envelope);
+    writer.write(m_noise.m_enabled);
+    writer.write(m_noise.m_shortMode);
+    writer.write(m_noise.m_period);
+    writer.write(m_noise.m_length);
+    writer.write(m_noise.m_shift);
+    writer.write(m_noise.m_counter);
+
+    writer.write(m_dmc.m_irqEnabled);
+    writer.write(m_dmc.m_loop);
+    writer.write(m_dmc.m_rate);
+    writer.write(m_dmc.m_level);
+    writer.write(m_dmc.m_sampleAddress);
+    writer.write(m_dmc.m_sampleLength);
+    writer.write(m_dmc.m_counter);
+    writer.write(m_dmc.m_address);
+    writer.write(m_dmc.m_remaining);
+    writer.write(m_dmc.m_buffer);
+    writer.write(m_dmc.m_bufferFull);
+    writer.write(m_dmc.m_shift);
+    writer.write(m_dmc.m_bits);
+    writer.write(m_dmc.m_silence);
+
+    writer.write(m_fiveStep);
+    writer.write(m_irqInhibit);
+    writer.write(m_frameIrq);
+    writer.write(m_dmcIrq);
+    writer.write(m_frameStep);
+    writer.write(m_frameCycle);
+}
+
+// =====================================================================================================================
+void APU::loadState(StateReader& reader)
+{
+    reader.beginSection("APU ");
+
+    loadPulse(reader, m_pulse[0]);
+    loadPulse(reader, m_pulse[1]);
+
+    m_triangle.m_enabled = reader.read<bool>();
+    m_triangle.m_control = reader.read<bool>();
+    m_triangle.m_linearReload = reader.read<bool>();
+    m_triangle.m_linearPeriod = readLimited<uint8_t>(reader, 0x7f);
+    m_triangle.m_linear = readLimited<uint8_t>(reader, 0x7f);
+    m_triangle.m_length = reader.read<uint8_t>();
+    m_triangle.m_step = readLimited<uint8_t>(reader, 31);
+    m_triangle.m_timer = readLimited<uint16_t>(reader, 0x7ff);
+    m_triangle.m_counter = readCounter(reader);
+
+    loadEnvelope(reader, m_noise.m_envelope);
+    m_noise.m_enabled = reader.read<bool>();
+    m_noise.m_shortMode = reader.read<bool>();
+    m_noise.m_period = readLimited<uint8_t>(reader, 15);
+    m_noise.m_length = reader.read<uint8_t>();
+    m_noise.m_shift = readLimited<uint16_t>(reader, 0x7fff);
+    m_noise.m_counter = readCounter(reader);
+
+    m_dmc.m_irqEnabled = reader.read<bool>();
+    m_dmc.m_loop = reader.read<bool>();
+    m_dmc.m_rate = readLimited<uint8_t>(reader, 15);
+    m_dmc.m_level = readLimited<uint8_t>(reader, 127);
+    m_dmc.m_sampleAddress = reader.read<uint16_t>();
+    m_dmc.m_sampleLength = reader.read<uint16_t>();
+    m_dmc.m_counter = readCounter(reader);
+    m_dmc.m_address = reader.read<uint16_t>();
+    m_dmc.m_remaining = reader.read<uint16_t>();
+    m_dmc.m_buffer = reader.read<uint8_t>();
+    m_dmc.m_bufferFull = reader.read<bool>();
+    m_dmc.m_shift = reader.read<uint8_t>();
+    m_dmc.m_bits = readLimited<uint8_t>(reader, 8);
+
+    if (m_dmc.m_bits == 0)
+	throw StateException("invalid APU state");
+
+    m_dmc.m_silence = reader.read<bool>();
+
+    m_fiveStep = reader.read<bool>();
+    m_irqInhibit = reader.read<bool>();
+    m_frameIrq = reader.read<bool>();
+    m_dmcIrq = reader.read<bool>();
+    m_frameStep = readLimited<unsigned>(reader, 4);
+    m_frameCycle = reader.read<uint32_t>();
+
+    // the frame counter runs up to the cycle of its next step
+    if (m_frameCycle > (m_frameStep < 4 ? s_frameSteps[m_fiveStep][m_frameStep] : s_framePeriods[m_fiveStep]))
+	throw StateException("invalid APU state");
+
+    // the state holds no absolute cycles, the channels and the audio frame continue from the restored cycle counter
+    m_time = m_cycles;
+    m_frameStart = m_cycles;
+
+    updateLevels();
+    updateNextEvent();
+}
+
+// =====================================================================================================================
+uint8_t APU::read(uint16_t address)
+{
+    // only the status register can be read, the others are open bus
+    if (address != 0x15)
+	return 0;
+
+    run(m_cycles);
+
+    uint8_t data = (m_pulse[0].m_length > 0 ? 0x01 : 0) |
+		   (m_pulse[1].m_length > 0 ? 0x02 : 0) |
+		   (m_triangle.m_length > 0 ? 0x04 : 0) |
+		   (m_noise.m_length > 0 ? 0x08 : 0) |
+		   (m_dmc.m_remaining > 0 ? 0x10 : 0) |
+		   (m_frameIrq ? 0x40 : 0) |
+		   (m_dmcIrq ? 0x80 : 0);
+
+    m_frameIrq = false;
+
+    return data;
+}
+
+// =====================================================================================================================
+void APU::write(uint16_t address, uint8_t data)
+{
+    // the write takes effect at the current cycle, everything before it is done with the old register values
+    run(m_cycles);
+
+    switch (address)
+    {
+	case 0x00 :
+	case 0x04 :
+	{
+	    Pulse& pulse = m_pulse[address / 4];
+	    pulse.m_duty = data >> 6;
+	    pulse.m_envelope.m_loop = data & 0x20;
+	    pulse.m_envelope.m_constant = data & 0x10;
+	    pulse.m_envelope.m_volume = data & 0xf;
+	    break;
+	}
+
+	case 0x01 :
+	case 0x05 :
+	{
+	    Pulse& pulse = m_pulse[address / 4];
+	    pulse.m_sweepEnabled = data & 0x80;
+	    pulse.m_sweepPeriod = (data >> 4) & 0x7;
+	    pulse.m_sweepNegate = data & 0x08;
+	    pulse.m_sweepShift = data & 0x7;
+	    pulse.m_sweepReload = true;
+	    break;
+	}
+
+	case 0x02 :
+	case 0x06 :
+	{
+	    Pulse& pulse = m_pulse[address / 4];
+	    pulse.m_timer = (pulse.m_timer & 0x700) | data;
+	    break;
+	}
+
+	case 0x03 :
+	case 0x07 :
+	{
+	    Pulse& pulse = m_pulse[address / 4];
+	    pulse.m_timer = (pulse.m_timer & 0xff) | ((data & 0x7) << 8);
+
+	    if (pulse.m_enabled)
+		pulse.m_length = s_lengths[data >> 3];
+
+	    pulse.m_step = 0;
+	    pulse.m_envelope.m_start = true;
+	    break;
+	}
+
+	case 0x08 :
+	    m_triangle.m_control = data & 0x80;
+	    m_triangle.m_linearPeriod = data & 0x7f;
+	    break;
+
+	case 0x0a :
+	    m_triangle.m_timer = (m_triangle.m_timer & 0x700) | data;
+	    break;
+
+	case 0x0b :
+	    m_triangle.m_timer = (m_triangle.m_timer & 0xff) | ((data & 0x7) << 8);
+
+	    if (m_triangle.m_enabled)
+		m_triangle.m_length = s_lengths[data >> 3];
+
+	    m_triangle.m_linearReload = true;
+	    break;
+
+	case 0x0c :
+	    m_noise.m_envelope.m_loop = data & 0x20;
+	    m_noise.m_envelope.m_constant = data & 0x10;
+	    m_noise.m_envelope.m_volume = data & 0xf;
+	    break;
+
+	case 0x0e :
+	    m_noise.m_shortMode = data & 0x80;
+	    m_noise.m_period = data & 0xf;
+	    break;
+
+	case 0x0f :
+	    if (m_noise.m_enabled)
+		m_noise.m_length = s_lengths[data >> 3];
+
+	    m_noise.m_envelope.m_start = true;
+	    break;
+
+	case 0x10 :
+	    m_dmc.m_irqEnabled = data & 0x80;
+	    m_dmc.m_loop = data & 0x40;
+	    m_dmc.m_rate = data & 0xf;
+
+	    if (!m_dmc.m_irqEnabled)
+		m_dmcIrq = false;
+	    break;
+
+	case 0x11 :
+	    m_dmc.m_level = data & 0x7f;
+	    break;
+
+	case 0x12 :
+	    m_dmc.m_sampleAddress = 0xc000 | (data << 6);
+	    break;
+
+	case 0x13 :
+	    m_dmc.m_sampleLength = (data << 4) | 1;
+	    break;
+
+	case 0x15 :
+	    m_pulse[0].m_enabled = data & 0x01;
+	    m_pulse[1].m_enabled = data & 0x02;
+	    m_triangle.m_enabled = data & 0x04;
+	    m_noise.m_enabled = data & 0x08;
+
+	    if (!m_pulse[0].m_enabled)
+		m_pulse[0].m_length = 0;
+	    if (!m_pulse[1].m_enabled)
+		m_pulse[1].m_length = 0;
+	    if (!m_triangle.m_enabled)
+		m_triangle.m_length = 0;
+	    if (!m_noise.m_enabled)
+		m_noise.m_length = 0;
+
+	    m_dmcIrq = false;
+
+	    if (!(data & 0x10))
+		m_dmc.m_remaining = 0;
+	    else if (m_dmc.m_remaining == 0)
+	    {
+		dmcRestart();
+		dmcFetch();
+	    }
+	    break;
+
+	case 0x17 :
+	    m_fiveStep = data & 0x80;
+	    m_irqInhibit = data & 0x40;
+
+	    if (m_irqInhibit)
+		m_frameIrq = false;
+
+	    m_frameStep = 0;
+	    m_frameCycle = 0;
+
+	    // the 5-step sequence clocks the units right away
+	    if (m_fiveStep)
+	    {
+		quarterFrame();
+		halfFrame();
+	    }
+	    break;
+
+	default :
+	    break;
+    }
+
+    updateLevels();
+    updateNextEvent();
+}
+
+// =====================================================================================================================
+void APU::run(uint64_t until)
+{
+    // The channels run without interaction between the frame counter steps, each of them is advanced over the whole
+    // stretch at once.
+    while (m_time < until)
+    {
+	uint32_t stepCycle = m_frameStep < 4 ? s_frameSteps[m_fiveStep][m_frameStep] : s_framePeriods[m_fiveStep];
+	uint64_t step = m_time + (stepCycle - m_frameCycle);
+	uint64_t end = std::min(until, step);
+
+	runPulse(PULSE1, m_time, end);
+	runPulse(PULSE2, m_time, end);
+	runTriangle(m_time, end);
+	runNoise(m_time, end);
+	runDmc(m_time, end);
+
+	m_frameCycle += end - m_time;
+	m_time = end;
+
+	if (end == step)
+	{
+	    clockFrameCounter();
+	    updateLevels();
+	}
+    }
+
+    updateNextEvent();
+}
+
+// =====================================================================================================================
+void APU::runPulse(unsigned channel, uint64_t from, uint64_t to)
+{
+    Pulse& pulse = m_pulse[channel];
+
+    uint32_t period = (pulse.m_timer + 1) * 2;
+    uint8_t volume = (pulse.m_length == 0 || pulseMuted(channel)) ? 0 : envelopeVolume(pulse.m_envelope);
+
+    // the sequencer of a silent channel is moved to its new position in one step
+    if (volume == 0)
+    {
+	pulse.m_step = (pulse.m_step + advanceTimer(pulse.m_counter, period, to - from)) & 7;
+	return;
+    }
+
+    uint64_t time = from + pulse.m_counter;
+
+    for (; time <= to; time += period)
+    {
+	pulse.m_step = (pulse.m_step + 1) & 7;
+	setLevel(channel, s_duties[pulse.m_duty][pulse.m_step] ? volume : 0, time);
+    }
+
+    pulse.m_counter = time - to;
+}
+
+// =====================================================================================================================
+void APU::runTriangle(uint64_t from, uint64_t to)
+{
+    // The sequencer stops while a counter is zero, the output keeps its level. Ultrasonic periods are stopped as well,
+    // they would only add inaudible steps.
+    if (m_triangle.m_length == 0 || m_triangle.m_linear == 0 || m_triangle.m_timer < 2)
+	return;
+
+    uint32_t period = m_triangle.m_timer + 1;
+    uint64_t time = from + m_triangle.m_counter;
+
+    for (; time <= to; time += period)
+    {
+	m_triangle.m_step = (m_triangle.m_step + 1) & 31;
+	setLevel(TRIANGLE, s_triangle[m_triangle.m_step], time);
+    }
+
+    m_triangle.m_counter = time - to;
+}
+
+// =====================================================================================================================
+void APU::runNoise(uint64_t from, uint64_t to)
+{
+    uint32_t period = s_noisePeriods[m_noise.m_period];
+    uint8_t volume = m_noise.m_length == 0 ? 0 : envelopeVolume(m_noise.m_envelope);
+    unsigned tap = m_noise.m_shortMode ? 6 : 1;
+
+    uint64_t time = from + m_noise.m_counter;
+
+    // the shift register has to be clocked even while the channel is silent
+    for (; time <= to; time += period)
+    {
+	uint16_t feedback = (m_noise.m_shift ^ (m_noise.m_shift >> tap)) & 1;
+	m_noise.m_shift = (m_noise.m_shift >> 1) | (feedback << 14);
+
+	if (volume != 0)
+	    setLevel(NOISE, (m_noise.m_shift & 1) ? 0 : volume, time);
+    }
+
+    m_noise.m_counter = time - to;
+}
+
+// =====================================================================================================================
+void APU::runDmc(uint64_t from, uint64_t to)
+{
+    uint32_t period = s_dmcPeriods[m_dmc.m_rate];
+    uint64_t time = from + m_dmc.m_counter;
+
+    for (; time <= to; time += period)
+    {
+	if (!m_dmc.m_silence)
+	{
+	    if (m_dmc.m_shift & 1)
+	    {
+		if (m_dmc.m_level <= 125)
+		    m_dmc.m_level += 2;
+	    }
+	    else if (m_dmc.m_level >= 2)
+		m_dmc.m_level -= 2;
+
+	    setLevel(DMC, m_dmc.m_level, time);
+	}
+
+	m_dmc.m_shift >>= 1;
+
+	// the next output cycle starts with the byte in the sample buffer
+	if (--m_dmc.m_bits == 0)
+	{
+	    m_dmc.m_bits = 8;
+	    m_dmc.m_silence = !m_dmc.m_bufferFull;
+
+	    if (m_dmc.m_bufferFull)
+	    {
+		m_dmc.m_shift = m_dmc.m_buffer;
+		m_dmc.m_bufferFull = false;
+		dmcFetch();
+	    }
+	}
+    }
+
+    m_dmc.m_counter = time - to;
+}
+
+// =====================================================================================================================
+void APU::clockFrameCounter()
+{
+    // the end of the sequence
+    if (m_frameStep == 4)
+    {
+	m_frameStep = 0;
+	m_frameCycle = 0;
+	return;
+    }
+
+    quarterFrame();
+
+    if (m_frameStep == 1 || m_frameStep == 3)
+	halfFrame();
+
+    if (m_frameStep == 3 && !m_fiveStep && !m_irqInhibit)
+    {
+	m_frameIrq = true;
+	raiseIrq();
+    }
+
+    ++m_frameStep;
+}
+
+// =====================================================================================================================
+void APU::quarterFrame()
+{
+    clockEnvelope(m_pulse[0].m_envelope);
+    clockEnvelope(m_pulse[1].m_envelope);
+    clockEnvelope(m_noise.m_envelope);
+
+    if (m_triangle.m_linearReload)
+	m_triangle.m_linear = m_triangle.m_linearPeriod;
+    else if (m_triangle.m_linear > 0)
+	--m_triangle.m_linear;
+
+    if (!m_triangle.m_control)
+	m_triangle.m_linearReload = false;
+}
+
+// =====================================================================================================================
+void APU::halfFrame()
+{
+    for (unsigned i = 0; i < 2; ++i)
+    {
+	if (!m_pulse[i].m_envelope.m_loop && m_pulse[i].m_length > 0)
+	    --m_pulse[i].m_length;
+
+	clockSweep(i);
+    }
+
+    if (!m_triangle.m_control && m_triangle.m_length > 0)
+	--m_triangle.m_length;
+
+    if (!m_noise.m_envelope.m_loop && m_noise.m_length > 0)
+	--m_noise.m_length;
+}
+
+// =====================================================================================================================
+void APU::clockEnvelope(Envelope& envelope)
+{
+    if (envelope.m_start)
+    {
+	envelope.m_start = false;
+	envelope.m_decay = 15;
+	envelope.m_divider = envelope.m_volume;
+    }
+    else if (envelope.m_divider == 0)
+    {
+	envelope.m_divider = envelope.m_volume;
+
+	if (envelope.m_decay > 0)
+	    --envelope.m_decay;
+	else if (envelope.m_loop)
+	    envelope.m_decay = 15;
+    }
+    else
+	--envelope.m_divider;
+}
+
+// =====================================================================================================================
+void APU::clockSweep(unsigned channel)
+{
+    Pulse& pulse = m_pulse[channel];
+
+    if (pulse.m_sweepDivider == 0 && pulse.m_sweepEnabled && pulse.m_sweepShift != 0 && !pulseMuted(channel))
+	pulse.m_timer = sweepTarget(channel);
+
+    if (pulse.m_sweepDivider == 0 || pulse.m_sweepReload)
+    {
+	pulse.m_sweepDivider = pulse.m_sweepPeriod;
+	pulse.m_sweepReload = false;
+    }
+    else
+	--pulse.m_sweepDivider;
+}
+
+// =====================================================================================================================
+uint8_t APU::envelopeVolume(const Envelope& envelope) const
+{
+    return envelope.m_constant ? envelope.m_volume : envelope.m_decay;
+}
+
+// =====================================================================================================================
+unsigned APU::sweepTarget(unsigned channel) const
+{
+    const Pulse& pulse = m_pulse[channel];
+    unsigned change = pulse.m_timer >> pulse.m_sweepShift;
+
+    if (!pulse.m_sweepNegate)
+	return pulse.m_timer + change;
+
+    // the first pulse channel negates with the ones' complement
+    if (channel == PULSE1)
+	++change;
+
+    return change > pulse.m_timer ? 0 : pulse.m_timer - change;
+}
+
+// =====================================================================================================================
+bool APU::pulseMuted(unsigned channel) const
+{
+    return m_pulse[channel].m_timer < 8 || sweepTarget(channel) > 0x7ff;
+}
+
+// =====================================================================================================================
+void APU::dmcFetch()
+{
+    if (m_dmc.m_bufferFull || m_dmc.m_remaining == 0)
+	return;
+
+    // the CPU is stalled while the DMC reads, the stall is not emulated
+    m_dmc.m_buffer = m_memory.read(m_dmc.m_address);
+    m_dmc.m_bufferFull = true;
+    m_dmc.m_address = m_dmc.m_address == 0xffff ? 0x8000 : m_dmc.m_address + 1;
+
+    if (--m_dmc.m_remaining == 0)
+    {
+	if (m_dmc.m_loop)
+	    dmcRestart();
+	else if (m_dmc.m_irqEnabled)
+	{
+	    m_dmcIrq = true;
+	    raiseIrq();
+	}
+    }
+}
+
+// =====================================================================================================================
+void APU::dmcRestart()
+{
+    m_dmc.m_address = m_dmc.m_sampleAddress;
+    m_dmc.m_remaining = m_dmc.m_sampleLength;
+}
+
+// =====================================================================================================================
+void APU::updateLevels()
+{
+    for (unsigned i = 0; i < 2; ++i)
+    {
+	const Pulse& pulse = m_pulse[i];
+	bool silent = pulse.m_length == 0 || pulseMuted(i) || !s_duties[pulse.m_duty][pulse.m_step];
+
+	setLevel(i, silent ? 0 : envelopeVolume(pulse.m_envelope), m_time);
+    }
+
+    setLevel(TRIANGLE, s_triangle[m_triangle.m_step], m_time);
+
+    bool silent = m_noise.m_length == 0 || (m_noise.m_shift & 1);
+    setLevel(NOISE, silent ? 0 : envelopeVolume(m_noise.m_envelope), m_time);
+
+    setLevel(DMC, m_dmc.m_level, m_time);
+}
+
+// =====================================================================================================================
+void APU::setLevel(unsigned channel, uint8_t level, uint64_t time)
+{
+    if (m_levels[channel] == level)
+	return;
+
+    m_levels[channel] = level;
+
+    if (!m_audioOutput || !m_sampleCallback)
+	return;
+
+    float output = mix();
+    m_blip.addDelta(time - m_frameStart, output - m_mix);
+    m_mix = output;
+}
+
+// =====================================================================================================================
+float APU::mix() const
+{
+    static const MixerTables s_tables;
+
+    return s_tables.m_pulse[m_levels[PULSE1] + m_levels[PULSE2]] +
+	   s_tables.m_tnd[3 * m_levels[TRIANGLE] + 2 * m_levels[NOISE] + m_levels[DMC]];
+}
+
+// =====================================================================================================================
+void APU::raiseIrq()
+{
+    if (m_irqCallback)
+	m_irqCallback();
+}
+
+// =====================================================================================================================
+void APU::updateNextEvent()
+{
+    m_nextEvent = std::numeric_limits<uint64_t>::max();
+
+    // the IRQ of the 4-step sequence
+    if (!m_fiveStep && !m_irqInhibit)
+    {
+	uint32_t irqCycle = s_frameSteps[0][3];
+
+	if (m_frameStep <= 3)
+	    m_nextEvent = m_time + (irqCycle - m_frameCycle);
+	else
+	    m_nextEvent = m_time + (s_framePeriods[0] - m_frameCycle) + irqCycle;
+    }
+
+    // the IRQ at the end of the sample, the last byte is fetched at the start of the output cycle it is played in
+    if (m_dmc.m_irqEnabled && !m_dmc.m_loop && m_dmc.m_remaining > 0)
+    {
+	uint64_t period = s_dmcPeriods[m_dmc.m_rate];
+	uint64_t cycleStart = m_time + m_dmc.m_counter + (m_dmc.m_bits - 1) * period;
+
+	m_nextEvent = std::min(m_nextEvent, cycleStart + (m_dmc.m_remaining - 1) * 8 * period);
+    }
+}
@@ -0,0 +1,96 @@
+#include <nemu/audiooutput.h>
+
+#include <algorithm>
+
+#include <SDL/SDL.h>
+
+/// samples queued between the emulation and the device, about 85 ms at 48 kHz
+static const unsigned QUEUE_CAPACITY = 4096;
+/// samples the device requests at once
+static const unsigned DEVICE_SAMPLES = 512;
+/// largest relative change of the sample rate
+static const double MAX_RATE_DELTA = 0.005;
+
+// =====================================================================================================================
+AudioOutput::AudioOutput(unsigned sampleRate)
+    : m_sampleRate(sampleRate),
+      m_queue(QUEUE_CAPACITY),
+      m_playing(false),
+      m_lastSample(0),
+      m_underruns(0)
+{
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
+	throw AudioException("unable to initialise audio");
+
+    SDL_AudioSpec desired;
+    desired.freq = sampleRate;
+    desired.format = AUDIO_S16SYS;
+    desired.channels = 1;
+    desired.samples = DEVICE_SAMPLES;
+    desired.callback = &AudioOutput::fill;
+    desired.userdata = this;
+
+    // without an obtained spec SDL converts the samples to whatever the device supports, the callback always gets
+    // mono 16 bit samples at the requested rate
+    if (SDL_OpenAudio(&desired, nullptr) != 0)
+    {
+	SDL_QuitSubSystem(SDL_INIT_AUDIO);
+	throw AudioException("unable to open the audio device");
+    }
+}
+
+// =====================================================================================================================
+AudioOutput::~AudioOutput()
+{
+    SDL_CloseAudio();
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
+
+// =====================================================================================================================
+void AudioOutput::submit(const int16_t* samples, unsigned count)
+{
+    // samples that do not fit are dropped, this only happens while running faster than real time
+    m_queue.push(samples, count);
+
+    if (!m_playing && m_queue.size() >= m_queue.capacity() / 2)
+    {
+	m_playing = true;
+	SDL_PauseAudio(0);
+    }
+}
+
+// =====================================================================================================================
+double AudioOutput::sampleRate() const
+{
+    // -1 for an empty queue, 1 for a full one
+    double fill = 2.0 * m_queue.size() / m_queue.capacity() - 1.0;
+    fill = std::max(-1.0, std::min(1.0, fill));
+
+    return m_sampleRate * (1.0 - MAX_RATE_DELTA * fill);
+}
+
+// =====================================================================================================================
+unsigned AudioOutput::underruns() const
+{
+    return m_underruns.load(std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+void AudioOutput::fill(void* userdata, uint8_t* stream, int length)
+{
+    AudioOutput* output = static_cast<AudioOutput*>(userdata);
+
+    int16_t* samples = reinterpret_cast<int16_t*>(stream);
+    unsigned count = length / sizeof(int16_t);
+
+    unsigned taken = output->m_queue.pop(samples, count);
+
+    if (taken > 0)
+	output->m_lastSample = samples[taken - 1];
+
+    if (taken < count)
+    {
+	std::fill(samples + taken, samples + count, output->m_lastSample);
+	output->m_underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,64 @@
+#include <nemu/audioqueue.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+// =====================================================================================================================
+AudioQueue::AudioQueue(unsigned capacity)
+    : m_capacity(capacity),
+      m_samples(capacity),
+      m_head(0),
+      m_tail(0)
+{
+}
+
+// =====================================================================================================================
+unsigned AudioQueue::push(const int16_t* samples, unsigned count)
+{
+    unsigned tail = m_tail.load(std::memory_order_relaxed);
+
+    count = std::min(count, m_capacity - (tail - m_head.load(std::memory_order_acquire)));
+
+    // the free space may wrap around the end of the ring
+    unsigned position = tail & (m_capacity - 1);
+    unsigned first = std::min(count, m_capacity - position);
+
+    memcpy(&m_samples[position], samples, first * sizeof(int16_t));
+    memcpy(&m_samples[0], samples + first, (count - first) * sizeof(int16_t));
+
+    // publish the samples together with the new position
+    m_tail.store(tail + count, std::memory_order_release);
+
+    return count;
+}
+
+// =====================================================================================================================
+unsigned AudioQueue::pop(int16_t* samples, unsigned count)
+{
+    unsigned head = m_head.load(std::memory_order_relaxed);
+
+    count = std::min(count, m_tail.load(std::memory_order_acquire) - head);
+
+    unsigned position = head & (m_capacity - 1);
+    unsigned first = std::min(count, m_capacity - position);
+
+    memcpy(samples, &m_samples[position], first * sizeof(int16_t));
+    memcpy(samples + first, &m_samples[0], (count - first) * sizeof(int16_t));
+
+    m_head.store(head + count, std::memory_order_release);
+
+    return count;
+}
+
+// =====================================================================================================================
+unsigned AudioQueue::size() const
+{
+    return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+}
+
+// =====================================================================================================================
+unsigned AudioQueue::capacity() const
+{
+    return m_capacity;
+}
@@ -0,0 +1,145 @@
+#include <nemu/blipbuffer.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <string.h>
+
+/// number of sub-sample positions a step can be placed at
+static const unsigned PHASE_BITS = 5;
+static const unsigned PHASES = 1 << PHASE_BITS;
+/// width of a step in samples, the samples are delayed by half of it
+static const unsigned TAPS = 16;
+
+/// the band-limited impulses of all phases, integrating one of them gives a step
+struct BlipKernel
+{
+    BlipKernel()
+    {
+	const double pi = 3.14159265358979323846;
+	// cut off a bit below the Nyquist frequency to keep the transition band of the short kernel out of the audio
+	const double cutoff = 0.9;
+	const double half = TAPS / 2;
+
+	for (unsigned phase = 0; phase < PHASES; ++phase)
+	{
+	    double sum = 0.0;
+
+	    for (unsigned k = 0; k < TAPS; ++k)
+	    {
+		double x = k - half - double(phase) / PHASES;
+		double sinc = x == 0.0 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+		double window = 0.42 + 0.5 * std::cos(pi * x / half) + 0.08 * std::cos(2 * pi * x / half);
+
+		m_values[phase][k] = sinc * window;
+		sum += m_values[phase][k];
+	    }
+
+	    // every step has to reach its full size
+	    for (unsigned k = 0; k < TAPS; ++k)
+		m_values[phase][k] /= sum;
+	}
+    }
+
+    float m_values[PHASES][TAPS];
+};
+
+/// pole of the DC blocking high-pass, about 30 Hz at 48 kHz
+static const float HIGHPASS = 0.996f;
+
+// =====================================================================================================================
+BlipBuffer::BlipBuffer(unsigned capacity)
+    : m_factor(0),
+      m_offset(0),
+      m_buffer(capacity + TAPS, 0.0f),
+      m_capacity(capacity),
+      m_available(0),
+      m_integrator(0.0f),
+      m_lastInput(0.0f),
+      m_lastOutput(0.0f)
+{
+}
+
+// =====================================================================================================================
+void BlipBuffer::setRates(double clockRate, double sampleRate)
+{
+    m_factor = uint64_t(sampleRate / clockRate * 4294967296.0 + 0.5);
+}
+
+// =====================================================================================================================
+void BlipBuffer::addDelta(uint32_t clock, float delta)
+{
+    static const BlipKernel s_kernel;
+
+    uint64_t position = m_offset + clock * m_factor;
+
+    size_t index = position >> 32;
+    unsigned phase = (position >> (32 - PHASE_BITS)) & (PHASES - 1);
+
+    // steps of a frame longer than the buffer are lost
+    if (index + TAPS > m_buffer.size())
+	return;
+
+    float* out = &m_buffer[index];
+    const float* impulse = s_kernel.m_values[phase];
+
+    for (unsigned k = 0; k < TAPS; ++k)
+	out[k] += delta * impulse[k];
+}
+
+// =====================================================================================================================
+void BlipBuffer::endFrame(uint32_t clocks)
+{
+    m_offset += clocks * m_factor;
+
+    if ((m_offset >> 32) > m_capacity)
+	m_offset = uint64_t(m_capacity) << 32;
+
+    m_available = m_offset >> 32;
+}
+
+// =====================================================================================================================
+unsigned BlipBuffer::samplesAvailable() const
+{
+    return m_available;
+}
+
+// =====================================================================================================================
+unsigned BlipBuffer::readSamples(int16_t* samples, unsigned count)
+{
+    count = std::min(count, m_available);
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+	m_integrator += m_buffer[i];
+
+	float output = m_integrator - m_lastInput + HIGHPASS * m_lastOutput;
+	m_lastInput = m_integrator;
+	m_lastOutput = output;
+
+	int sample = int(output * 32767.0f);
+	samples[i] = std::max(-32768, std::min(32767, sample));
+    }
+
+    // move the samples still being built to the front
+    unsigned remaining = m_available - count + TAPS;
+    memmove(m_buffer.data(), m_buffer.data() + count, remaining * sizeof(float));
+    std::fill(m_buffer.begin() + remaining, m_buffer.begin() + remaining + count, 0.0f);
+
+    m_available -= count;
+    m_offset -= uint64_t(count) << 32;
+
+    return count;
+}
+
+// =====================================================================================================================
+void BlipBuffer::clear()
+{
+    std::fill(m_buffer.begin(), m_buffer.end(), 0.0f);
+
+    m_offset = 0;
+    m_available = 0;
+    m_integrator = 0.0f;
+    m_lastInput = 0.0f;
+    m_lastOutput = 0.0f;
+}
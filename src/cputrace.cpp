@@ -0,0 +1,121 @@
+#include <nemu/cputrace.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+const char CpuTrace::s_magic[4] = {'N', 'T', 'R', 'C'};
+const uint32_t CpuTrace::s_version;
+
+// =====================================================================================================================
+CpuTrace::CpuTrace(const std::string& file, unsigned capacity, const memory::Dispatcher& bus, const uint64_t& cycles)
+    : m_bus(bus),
+      m_cycles(cycles),
+      m_first(0x0000),
+      m_last(0xffff),
+      m_triggered(true),
+      m_trigger(0)
+{
+    uint32_t size = 1;
+
+    while (size < capacity && size < 0x80000000u)
+	size <<= 1;
+
+    m_mask = size - 1;
+    m_mappingSize = sizeof(CpuTraceHeader) + size_t(size) * sizeof(CpuTraceRecord);
+
+    int fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+	throw std::system_error(errno, std::system_category(), file);
+
+    if (::ftruncate(fd, m_mappingSize) != 0)
+    {
+	int error = errno;
+	::close(fd);
+	throw std::system_error(error, std::system_category(), file);
+    }
+
+    m_mapping = ::mmap(nullptr, m_mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (m_mapping == MAP_FAILED)
+    {
+	int error = errno;
+	::close(fd);
+	throw std::system_error(error, std::system_category(), file);
+    }
+
+    ::close(fd);
+
+    m_header = static_cast<CpuTraceHeader*>(m_mapping);
+    m_records = reinterpret_cast<CpuTraceRecord*>(m_header + 1);
+
+    memcpy(m_header->m_magic, s_magic, sizeof(s_magic));
+    m_header->m_version = s_version;
+    m_header->m_recordSize = sizeof(CpuTraceRecord);
+    m_header->m_capacity = size;
+    m_header->m_count = 0;
+}
+
+// =====================================================================================================================
+CpuTrace::~CpuTrace()
+{
+    ::munmap(m_mapping, m_mappingSize);
+}
+
+// =====================================================================================================================
+void CpuTrace::setRange(uint16_t first, uint16_t last)
+{
+    m_first = first;
+    m_last = last;
+}
+
+// =====================================================================================================================
+void CpuTrace::setTrigger(uint16_t address)
+{
+    m_triggered = false;
+    m_trigger = address;
+}
+
+// =====================================================================================================================
+uint64_t CpuTrace::count() const
+{
+    return m_header->m_count;
+}
+
+// =====================================================================================================================
+void CpuTrace::trace(const lib6502::Cpu::State& state, const std::string& inst)
+{
+    if (!m_triggered)
+    {
+	if (state.m_PC != m_trigger)
+	    return;
+
+	m_triggered = true;
+    }
+
+    if (state.m_PC < m_first || state.m_PC > m_last)
+	return;
+
+    uint64_t count = m_header->m_count;
+    CpuTraceRecord& record = m_records[count & m_mask];
+
+    record.m_tick = m_cycles;
+    record.m_PC = state.m_PC;
+    record.m_A = state.m_A;
+    record.m_X = state.m_X;
+    record.m_Y = state.m_Y;
+    record.m_status = state.m_status;
+    record.m_SP = state.m_SP;
+    record.m_flags = state.m_inInterrupt ? CpuTraceRecord::IN_INTERRUPT : 0;
+
+    for (unsigned i = 0; i < 3; ++i)
+	record.m_opcode[i] = m_bus.peek(state.m_PC + i);
+
+    // published after the record so a reader of a crashed run never sees a half written one
+    m_header->m_count = count + 1;
+}
@@ -0,0 +1,143 @@
+#include <nemu/framepacer.h>
+
+#include <errno.h>
+#include <time.h>
+
+const double FramePacer::FRAME_RATE = 60.0988;
+const double FramePacer::MIN_SPEED = 0.25;
+const double FramePacer::MAX_SPEED = 8.0;
+
+// the last part of a wait is spun as sleeping is not accurate enough for it
+static const uint64_t s_spinTime = 1000000;
+
+// =====================================================================================================================
+FramePacer::FramePacer()
+    : m_speed(1.0),
+      m_turbo(false),
+      m_late(false),
+      m_missedDeadlines(0),
+      m_maxLateness(0)
+{
+    restart();
+}
+
+// =====================================================================================================================
+void FramePacer::setSpeed(double speed)
+{
+    if (speed < MIN_SPEED)
+	speed = MIN_SPEED;
+    else if (speed > MAX_SPEED)
+	speed = MAX_SPEED;
+
+    m_speed = speed;
+    restart();
+}
+
+// =====================================================================================================================
+double FramePacer::speed() const
+{
+    return m_speed;
+}
+
+// =====================================================================================================================
+void FramePacer::setTurbo(bool turbo)
+{
+    if (m_turbo == turbo)
+	return;
+
+    m_turbo = turbo;
+
+    if (!m_turbo)
+	restart();
+}
+
+// =====================================================================================================================
+bool FramePacer::turbo() const
+{
+    return m_turbo;
+}
+
+// =====================================================================================================================
+void FramePacer::wait()
+{
+    m_late = false;
+
+    if (m_turbo)
+	return;
+
+    ++m_frames;
+
+    uint64_t deadline = m_start + uint64_t(m_frames * m_period);
+    uint64_t current = now();
+
+    m_late = current > deadline;
+
+    if (current >= deadline)
+    {
+	uint64_t lateness = current - deadline;
+
+	if (lateness > 0)
+	{
+	    ++m_missedDeadlines;
+
+	    if (lateness > m_maxLateness)
+		m_maxLateness = lateness;
+	}
+
+	// do not try to catch up after a stall of more than a frame, it would run the following frames unthrottled
+	if (lateness > m_period)
+	    restart();
+
+	return;
+    }
+
+    if (deadline - current > s_spinTime)
+    {
+	uint64_t wakeup = deadline - s_spinTime;
+
+	timespec t;
+	t.tv_sec = wakeup / 1000000000;
+	t.tv_nsec = wakeup % 1000000000;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, nullptr) == EINTR)
+	    ;
+    }
+
+    while (now() < deadline)
+	;
+}
+
+// =====================================================================================================================
+bool FramePacer::late() const
+{
+    return m_late;
+}
+
+// =====================================================================================================================
+uint64_t FramePacer::missedDeadlines() const
+{
+    return m_missedDeadlines;
+}
+
+// =====================================================================================================================
+uint64_t FramePacer::maxLateness() const
+{
+    return m_maxLateness;
+}
+
+// =====================================================================================================================
+uint64_t FramePacer::now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return uint64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
+// =====================================================================================================================
+void FramePacer::restart()
+{
+    m_period = 1000000000.0 / (FRAME_RATE * m_speed);
+    m_start = now();
+    m_frames = 0;
+}
@@ -0,0 +1,61 @@
+#include <nemu/framequeue.h>
+
+#include <string.h>
+
+// =====================================================================================================================
+FrameQueue::FrameQueue(unsigned capacity)
+    : m_capacity(capacity),
+      m_buffers(capacity * FRAME_SIZE),
+      m_head(0),
+      m_tail(0),
+      m_dropped(0)
+{
+}
+
+// =====================================================================================================================
+bool FrameQueue::push(const uint32_t* frame)
+{
+    unsigned tail = m_tail.load(std::memory_order_relaxed);
+
+    if (tail - m_head.load(std::memory_order_acquire) == m_capacity)
+    {
+	m_dropped.fetch_add(1, std::memory_order_relaxed);
+	return false;
+    }
+
+    memcpy(&m_buffers[(tail % m_capacity) * FRAME_SIZE], frame, FRAME_SIZE * sizeof(uint32_t));
+
+    // publish the contents of the buffer together with the new position
+    m_tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+// =====================================================================================================================
+const uint32_t* FrameQueue::front() const
+{
+    unsigned head = m_head.load(std::memory_order_relaxed);
+
+    if (head == m_tail.load(std::memory_order_acquire))
+	return nullptr;
+
+    return &m_buffers[(head % m_capacity) * FRAME_SIZE];
+}
+
+// =====================================================================================================================
+void FrameQueue::pop()
+{
+    m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// =====================================================================================================================
+unsigned FrameQueue::size() const
+{
+    return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+}
+
+// =====================================================================================================================
+unsigned FrameQueue::dropped() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
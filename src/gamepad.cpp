@@ -1,60 +1,51 @@
 #include <nemu/gamepad.h>
 
-#include <SDL/SDL.h>
-
-#include <iostream>
-
 // =====================================================================================================================
 GamePad::GamePad()
-    : m_data(new uint8_t[24]),
+    : m_buttons(0),
+      m_latched(0),
       m_position(0),
       m_resetInProgress(false)
 {
-    // reset all key button states
-    memset(m_data, 0, 24);
 }
 
 // =====================================================================================================================
-GamePad::~GamePad()
+void GamePad::setButton(Button button, bool pressed)
 {
-    delete[] m_data;
+    if (pressed)
+	m_buttons.fetch_or(1 << button, std::memory_order_relaxed);
+    else
+	m_buttons.fetch_and(~(1 << button), std::memory_order_relaxed);
 }
 
 // =====================================================================================================================
-void GamePad::pollEvents()
+uint8_t GamePad::buttons() const
 {
-    SDL_Event event;
-
-    while (SDL_PollEvent(&event))
-    {
-	//std::cout << "event=" << (unsigned)event.type << " symbol=" << (unsigned)event.key.keysym.sym << std::endl;
-	switch (event.type)
-	{
-	    case SDL_KEYDOWN :
-	    case SDL_KEYUP :
-	    {
-		unsigned keyState = event.type == SDL_KEYDOWN ? 1 : 0;
+    return m_buttons.load(std::memory_order_relaxed);
+}
 
-		switch (event.key.keysym.sym)
-		{
-		    case SDLK_UP : m_data[4] = keyState; break;
-		    case SDLK_DOWN : m_data[5] = keyState; break;
-		    case SDLK_LEFT : m_data[6] = keyState; break;
-		    case SDLK_RIGHT : m_data[7] = keyState; break;
-		    case SDLK_RETURN : m_data[3] = keyState; break;
-		    case SDLK_LCTRL : m_data[0] = keyState; break;
-		    case SDLK_SPACE : m_data[1] = keyState; break;
-		    case SDLK_s : m_data[2] = keyState; break;
-		    default : break;
-		}
+// =====================================================================================================================
+void GamePad::setInputCallback(const std::function<uint8_t()>& inputCallback)
+{
+    m_inputCallback = inputCallback;
+}
 
-		break;
-	    }
-	}
+// =====================================================================================================================
+void GamePad::saveState(StateWriter& writer) const
+{
+    writer.beginSection("PAD ");
+    writer.write(m_latched);
+    writer.write(m_position);
+    writer.write(m_resetInProgress);
+}
 
-	//if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE)
-	//m_running = false;
-    }
+// =====================================================================================================================
+void GamePad::loadState(StateReader& reader)
+{
+    reader.beginSection("PAD ");
+    m_latched = reader.read<uint8_t>();
+    m_position = reader.read<unsigned>();
+    m_resetInProgress = reader.read<bool>();
 }
 
 // =====================================================================================================================
@@ -65,10 +56,9 @@ uint8_t GamePad::read(uint16_t address)
     switch (address)
     {
 	case 0 :
-	    // $4016
-	    data = m_data[m_position];
+	    // $4016, the 8 buttons are followed by 16 zero bits
+	    data = m_position < 8 ? (m_latched >> m_position) & 1 : 0;
 	    m_position = (m_position + 1) % 24;
-	    //std::cout << "Gamepad data: " << (unsigned)data << std::endl;
 	    break;
 
 	default :
@@ -92,7 +82,9 @@ void GamePad::write(uint16_t address, uint8_t data)
 	    {
 		m_resetInProgress = false;
 		m_position = 0;
-		//std::cout << "strobe done" << std::endl;
+
+		// the buttons are read from a consistent state until the next strobe
+		m_latched = m_inputCallback ? m_inputCallback() : buttons();
 	    }
 
 	    break;
@@ -1,7 +1,7 @@
 #include <nemu/loader.h>
 
-#include <fcntl.h>
-#include <unistd.h>
+#include <cstring>
+#include <system_error>
 
 // =====================================================================================================================
 struct NesHeader
@@ -11,12 +11,76 @@ struct NesHeader
     uint8_t chrRomCount;
     uint8_t flags6;
     uint8_t flags7;
-    uint8_t prgRamCount;
+    uint8_t flags8;
     uint8_t flags9;
     uint8_t flags10;
     uint8_t zero[5];
 } __attribute__((packed));
 
+static const unsigned TRAINER_SIZE = 512;
+
+/// lookup table of the reflected CRC-32 polynomial
+struct CrcTable
+{
+    CrcTable()
+    {
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+	    uint32_t value = i;
+
+	    for (unsigned bit = 0; bit < 8; ++bit)
+		value = (value >> 1) ^ ((value & 1) ? 0xedb88320 : 0);
+
+	    m_values[i] = value;
+	}
+    }
+
+    uint32_t m_values[256];
+};
+
+// =====================================================================================================================
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+    static const CrcTable s_table;
+
+    crc = ~crc;
+
+    for (size_t i = 0; i < size; ++i)
+	crc = s_table.m_values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+/// returned for sizes too large for any file
+static const uint64_t INVALID_ROM_SIZE = ~uint64_t(0);
+
+// =====================================================================================================================
+static uint64_t nes2RomSize(uint8_t lsb, uint8_t msb, uint64_t unit)
+{
+    // exponent-multiplier notation, the LSB holds the exponent in its upper 6 and the multiplier in its lower 2 bits
+    if (msb == 0xf)
+    {
+	unsigned exponent = lsb >> 2;
+
+	if (exponent > 40)
+	    return INVALID_ROM_SIZE;
+
+	return (uint64_t(1) << exponent) * ((lsb & 3) * 2 + 1);
+    }
+
+    return ((uint64_t(msb) << 8) | lsb) * unit;
+}
+
+// =====================================================================================================================
+Loader::Loader()
+    : m_mapper(0),
+      m_mirroring(MIRROR_HORIZONTAL),
+      m_trainer(nullptr),
+      m_crc32(0),
+      m_nes2(false)
+{
+}
+
 // =====================================================================================================================
 const std::shared_ptr<memory::ROM> Loader::rom() const
 {
@@ -30,33 +94,119 @@ const std::shared_ptr<memory::ROM> Loader::vrom() const
 }
 
 // =====================================================================================================================
-bool Loader::load(const std::string& file)
+unsigned Loader::mapper() const
+{
+    return m_mapper;
+}
+
+// =====================================================================================================================
+Mirroring Loader::mirroring() const
+{
+    return m_mirroring;
+}
+
+// =====================================================================================================================
+const uint8_t* Loader::trainer() const
+{
+    return m_trainer;
+}
+
+// =====================================================================================================================
+uint32_t Loader::crc32() const
+{
+    return m_crc32;
+}
+
+// =====================================================================================================================
+bool Loader::isNes2() const
+{
+    return m_nes2;
+}
+
+// =====================================================================================================================
+void Loader::load(const std::string& file)
 {
-    uint8_t* data;
+    try
+    {
+	m_file = std::make_shared<memory::MappedFile>(file);
+    }
+    catch (const std::system_error& e)
+    {
+	throw LoaderException(e.what());
+    }
+
+    const uint8_t* data = m_file->data();
+    size_t size = m_file->size();
 
-    int f = ::open(file.c_str(), O_RDONLY);
+    if (size < sizeof(NesHeader))
+	throw LoaderException(file + ": file too short for an iNES header");
 
     NesHeader hdr;
-    if (read(f, &hdr, sizeof(hdr)) != sizeof(NesHeader))
-	return false;
+    memcpy(&hdr, data, sizeof(hdr));
+
+    if (memcmp(hdr.signature, "NES\x1a", 4) != 0)
+	throw LoaderException(file + ": not an iNES image");
+
+    m_nes2 = (hdr.flags7 & 0x0c) == 0x08;
+
+    uint64_t prgSize;
+    uint64_t chrSize;
+
+    // the low nibble of the mapper number is in flags 6, the high nibble in flags 7
+    m_mapper = hdr.flags6 >> 4;
+
+    if (m_nes2)
+    {
+	// NES 2.0 adds bits 8-11 of the mapper number and the MSBs of the ROM sizes
+	m_mapper |= (hdr.flags7 & 0xf0) | ((hdr.flags8 & 0x0f) << 8);
+
+	prgSize = nes2RomSize(hdr.prgRomCount, hdr.flags9 & 0x0f, 16384);
+	chrSize = nes2RomSize(hdr.chrRomCount, hdr.flags9 >> 4, 8192);
+
+	if (prgSize == INVALID_ROM_SIZE || chrSize == INVALID_ROM_SIZE)
+	    throw LoaderException(file + ": invalid NES 2.0 ROM size exponent");
+    }
+    else
+    {
+	// old dumping tools wrote their name into the unused bytes, flags 7 is garbage in that case
+	bool clean = hdr.zero[1] == 0 && hdr.zero[2] == 0 && hdr.zero[3] == 0 && hdr.zero[4] == 0;
+
+	if (clean)
+	    m_mapper |= hdr.flags7 & 0xf0;
+
+	prgSize = hdr.prgRomCount * 16384;
+	chrSize = hdr.chrRomCount * 8192;
+    }
+
+    if (prgSize == 0)
+	throw LoaderException(file + ": image has no PRG ROM");
 
-    data = new uint8_t[hdr.prgRomCount * 16384];
+    // bit 3 of flags 6 overrides the mirroring bit
+    if (hdr.flags6 & 0x08)
+	m_mirroring = MIRROR_FOUR_SCREEN;
+    else
+	m_mirroring = (hdr.flags6 & 0x01) ? MIRROR_VERTICAL : MIRROR_HORIZONTAL;
 
-    // read PRG rom contents (TODO: close the file in case of error)
-    if (read(f, data, hdr.prgRomCount * 16384) != hdr.prgRomCount * 16384)
-	return false;
+    uint64_t offset = sizeof(NesHeader);
 
-    m_rom.reset(new memory::ROM(data, hdr.prgRomCount * 16384));
+    m_trainer = nullptr;
 
-    data = new uint8_t[hdr.chrRomCount * 8192];
+    if (hdr.flags6 & 0x04)
+    {
+	m_trainer = data + offset;
+	offset += TRAINER_SIZE;
+    }
 
-    // TODO: see above ...
-    if (read(f, data, hdr.chrRomCount * 8192) != hdr.chrRomCount * 8192)
-	return false;
+    // written not to overflow with the sizes of a corrupt header
+    if (offset > size || prgSize > size - offset || chrSize > size - offset - prgSize)
+	throw LoaderException(file + ": image is truncated, the header announces " + std::to_string(prgSize) +
+			      " bytes of PRG and " + std::to_string(chrSize) + " bytes of CHR ROM");
 
-    m_vrom.reset(new memory::ROM(data, hdr.chrRomCount * 8192));
+    const uint8_t* prg = data + offset;
+    const uint8_t* chr = prg + prgSize;
 
-    close(f);
+    m_rom = std::make_shared<memory::ROM>(prg, prgSize, m_file);
+    m_vrom = std::make_shared<memory::ROM>(chr, chrSize, m_file);
 
-    return true;
+    m_crc32 = ::crc32(::crc32(0, prg, prgSize), chr, chrSize);
 }
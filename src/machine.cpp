@@ -0,0 +1,218 @@
+#include <nemu/machine.h>
+#include <nemu/spritedma.h>
+#include <nemu/profiler.h>
+
+/// "NEMU" followed by the format version
+static const char s_stateMagic[4] = {'N', 'E', 'M', 'U'};
+static const uint32_t s_stateVersion = 9;
+
+// =====================================================================================================================
+Machine::Machine(const Loader& cartridge)
+    : m_cycles(0),
+      m_stallCycles(0)
+{
+    // video ROM and the name table mirroring of the board
+    m_ppu = std::make_shared<PPU>(cartridge.vrom());
+    m_ppu->setMirroring(cartridge.mirroring());
+
+    // the mapper maps the program ROM and switches the banks of both
+    m_mapper = Mapper::create(cartridge.mapper(), cartridge.rom(), cartridge.vrom());
+    m_mapper->attach(m_memory, *m_ppu);
+
+    // the trainer is loaded into the PRG RAM of the cartridge
+    if (cartridge.trainer())
+    {
+	for (unsigned i = 0; i < 512; ++i)
+	    m_memory.write(0x7000 + i, cartridge.trainer()[i]);
+    }
+
+    // register 2kB system memory
+    m_ram = std::make_shared<memory::RAM>(0x800);
+    for (unsigned i = 0; i < 4; ++i)
+	m_memory.registerHandler(i * 0x800, 0x800, m_ram);
+
+    m_cpu.reset(new lib6502::Cpu(m_memory));
+
+    // register PPU mappings
+    m_memory.registerHandler(0x2000, 8, m_ppu);
+    m_ppu->setNmiCallback(std::bind(&lib6502::Cpu::nmi, m_cpu.get()));
+    m_mapper->setIrqCallback(std::bind(&lib6502::Cpu::irq, m_cpu.get()));
+
+    // register gamepad
+    m_gamepad = std::make_shared<GamePad>();
+    m_memory.registerHandler(0x4016, 1, m_gamepad);
+
+    // register sprite DMA engine, the CPU is halted during its transfers
+    std::shared_ptr<SpriteDMA> spriteDma = std::make_shared<SpriteDMA>(m_memory, *m_ppu->spriteRam(), m_cycles);
+    spriteDma->setStallCallback([this](unsigned cycles) { m_stallCycles += cycles; });
+    m_memory.registerHandler(0x4014, 1, spriteDma);
+
+    // The APU covers $4000-$4017, the handlers registered before it take precedence for $4014 and $4016. $4017 is
+    // written to the frame counter and read as the second controller, which is not connected.
+    m_apu = std::make_shared<APU>(m_memory, m_cycles);
+    m_apu->setIrqCallback(std::bind(&lib6502::Cpu::irq, m_cpu.get()));
+    m_memory.registerHandler(0x4000, 0x18, m_apu);
+}
+
+// =====================================================================================================================
+void Machine::runFrame()
+{
+    unsigned frame = m_ppu->frameCount();
+
+    while (m_ppu->frameCount() == frame)
+    {
+#ifdef NEMU_PROFILE
+	if (m_cycles % profile::SAMPLE_INTERVAL == 0)
+	{
+	    {
+		profile::ScopedTimer timer(profile::PPU_TICK, profile::SAMPLE_INTERVAL);
+		m_ppu->tick();
+		m_ppu->tick();
+		m_ppu->tick();
+	    }
+
+	    {
+		profile::ScopedTimer timer(profile::CPU, profile::SAMPLE_INTERVAL);
+
+		if (m_stallCycles != 0)
+		    --m_stallCycles;
+		else
+		    m_cpu->tick();
+	    }
+
+	    if (++m_cycles >= m_apu->nextEvent())
+		m_apu->update();
+	    continue;
+	}
+#endif
+
+	m_ppu->tick();
+	m_ppu->tick();
+	m_ppu->tick();
+
+	// the CPU is halted while the sprite DMA runs
+	if (m_stallCycles != 0)
+	    --m_stallCycles;
+	else
+	    m_cpu->tick();
+
+	// the APU catches up on its own only when an IRQ is due
+	if (++m_cycles >= m_apu->nextEvent())
+	    m_apu->update();
+    }
+
+    m_apu->endFrame();
+}
+
+// =====================================================================================================================
+void Machine::saveState(std::vector<uint8_t>& buffer) const
+{
+    buffer.clear();
+
+    StateWriter writer(buffer);
+
+    writer.write(s_stateMagic, sizeof(s_stateMagic));
+    writer.write(s_stateVersion);
+
+    writer.beginSection("CPU ");
+    const lib6502::Cpu::State& cpu = m_cpu->getState();
+    writer.write(cpu.m_PC);
+    writer.write(cpu.m_A);
+    writer.write(cpu.m_X);
+    writer.write(cpu.m_Y);
+    writer.write(cpu.m_status);
+    writer.write(cpu.m_SP);
+    writer.write(cpu.m_inInterrupt);
+    writer.write(m_stallCycles);
+    // the length of a sprite DMA stall depends on the parity of the cycle counter
+    writer.write(m_cycles);
+
+    writer.beginSection("RAM ");
+    m_ram->saveState(writer);
+
+    m_apu->saveState(writer);
+    m_ppu->saveState(writer);
+    m_mapper->saveState(writer);
+    m_gamepad->saveState(writer);
+}
+
+// =====================================================================================================================
+void Machine::loadState(const std::vector<uint8_t>& buffer)
+{
+    StateReader reader(buffer.data(), buffer.size());
+
+    char magic[4];
+    reader.read(magic, sizeof(magic));
+
+    if (memcmp(magic, s_stateMagic, sizeof(magic)) != 0)
+	throw StateException("not a save state");
+
+    if (reader.read<uint32_t>() != s_stateVersion)
+	throw StateException("unsupported save state version");
+
+    reader.beginSection("CPU ");
+    lib6502::Cpu::State cpu;
+    cpu.m_PC = reader.read<uint16_t>();
+    cpu.m_A = reader.read<uint8_t>();
+    cpu.m_X = reader.read<uint8_t>();
+    cpu.m_Y = reader.read<uint8_t>();
+    cpu.m_status = reader.read<uint8_t>();
+    cpu.m_SP = reader.read<uint8_t>();
+    cpu.m_inInterrupt = reader.read<bool>();
+    m_cpu->setState(cpu);
+    m_stallCycles = reader.read<unsigned>();
+    m_cycles = reader.read<uint64_t>();
+
+    reader.beginSection("RAM ");
+    m_ram->loadState(reader);
+
+    m_apu->loadState(reader);
+    m_ppu->loadState(reader);
+    m_mapper->loadState(reader);
+    m_gamepad->loadState(reader);
+
+    if (!reader.atEnd())
+	throw StateException("unexpected data at the end of the save state");
+}
+
+// =====================================================================================================================
+lib6502::Cpu& Machine::cpu()
+{
+    return *m_cpu;
+}
+
+// =====================================================================================================================
+memory::Dispatcher& Machine::bus()
+{
+    return m_memory;
+}
+
+// =====================================================================================================================
+PPU& Machine::ppu()
+{
+    return *m_ppu;
+}
+
+// =====================================================================================================================
+APU& Machine::apu()
+{
+    return *m_apu;
+}
+
+// =====================================================================================================================
+const std::shared_ptr<GamePad>& Machine::gamepad() const
+{
+    return m_gamepad;
+}
+
+// =====================================================================================================================
+const uint8_t* Machine::ram() const
+{
+    return m_ram->data();
+}
+
+// =====================================================================================================================
+const uint64_t& Machine::cycles() const
+{
+    return m_cycles;
+}
@@ -0,0 +1,34 @@
+#include <nemu/mapper/cnrom.h>
+
+// =====================================================================================================================
+CNROM::CNROM(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr)
+    : Mapper(prg, chr),
+      m_chrBank(0)
+{
+}
+
+// =====================================================================================================================
+void CNROM::writeRegister(uint16_t address, uint8_t data)
+{
+    m_chrBank = data;
+    mapChr(0, 8, m_chrBank);
+}
+
+// =====================================================================================================================
+void CNROM::updateBanks()
+{
+    mapPrg(0x8000, 0x8000, 0);
+    mapChr(0, 8, m_chrBank);
+}
+
+// =====================================================================================================================
+void CNROM::saveRegisters(StateWriter& writer) const
+{
+    writer.write(m_chrBank);
+}
+
+// =====================================================================================================================
+void CNROM::loadRegisters(StateReader& reader)
+{
+    m_chrBank = reader.read<uint8_t>();
+}
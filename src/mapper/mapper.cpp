@@ -0,0 +1,124 @@
+#include <nemu/mapper/mapper.h>
+#include <nemu/mapper/nrom.h>
+#include <nemu/mapper/mmc1.h>
+#include <nemu/mapper/uxrom.h>
+#include <nemu/mapper/cnrom.h>
+#include <nemu/mapper/mmc3.h>
+#include <nemu/ppu.h>
+
+#include <lib6502/makestring.h>
+
+#include <string.h>
+
+using lib6502::MakeString;
+
+// =====================================================================================================================
+Mapper::Mapper(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr)
+    : m_prg(prg),
+      m_chr(chr),
+      m_bus(nullptr),
+      m_ppu(nullptr),
+      m_prgRam(std::make_shared<memory::RAM>(0x2000))
+{
+    memset(m_prgRam->data(), 0, m_prgRam->size());
+}
+
+// =====================================================================================================================
+std::shared_ptr<Mapper> Mapper::create(unsigned number, const std::shared_ptr<memory::ROM>& prg,
+				       const std::shared_ptr<memory::ROM>& chr)
+{
+    if (prg->size() == 0 || prg->size() % 0x2000 != 0)
+	throw MapperException(MakeString() << "invalid PRG ROM size: " << prg->size());
+
+    switch (number)
+    {
+	case 0 : return std::make_shared<NROM>(prg, chr);
+	case 1 : return std::make_shared<MMC1>(prg, chr);
+	case 2 : return std::make_shared<UxROM>(prg, chr);
+	case 3 : return std::make_shared<CNROM>(prg, chr);
+	case 4 : return std::make_shared<MMC3>(prg, chr);
+    }
+
+    throw MapperException(MakeString() << "unsupported mapper: " << number);
+}
+
+// =====================================================================================================================
+void Mapper::attach(memory::Dispatcher& bus, PPU& ppu)
+{
+    m_bus = &bus;
+    m_ppu = &ppu;
+
+    m_bus->registerHandler(0x6000, 0xa000, shared_from_this());
+    m_bus->mapPages(0x6000, m_prgRam->size(), m_prgRam->data(), m_prgRam->data());
+
+    updateBanks();
+}
+
+// =====================================================================================================================
+void Mapper::setIrqCallback(const std::function<void()>& irqCallback)
+{
+    m_irqCallback = irqCallback;
+}
+
+// =====================================================================================================================
+void Mapper::saveState(StateWriter& writer) const
+{
+    writer.beginSection("MAPR");
+    m_prgRam->saveState(writer);
+    saveRegisters(writer);
+}
+
+// =====================================================================================================================
+void Mapper::loadState(StateReader& reader)
+{
+    reader.beginSection("MAPR");
+    m_prgRam->loadState(reader);
+    loadRegisters(reader);
+
+    updateBanks();
+}
+
+// =====================================================================================================================
+uint8_t Mapper::read(uint16_t address)
+{
+    return 0;
+}
+
+// =====================================================================================================================
+void Mapper::write(uint16_t address, uint8_t data)
+{
+    address += 0x6000;
+
+    if (address >= 0x8000)
+	writeRegister(address, data);
+}
+
+// =====================================================================================================================
+void Mapper::mapPrg(uint16_t address, unsigned size, unsigned bank)
+{
+    // mapped in 8kB pieces so small images are mirrored in large windows, writes go to the mapper as register writes
+    for (unsigned i = 0; i < size; i += 0x2000)
+    {
+	unsigned offset = (bank * size + i) % m_prg->size();
+	m_bus->mapPages(address + i, 0x2000, m_prg->data() + offset, nullptr);
+    }
+}
+
+// =====================================================================================================================
+void Mapper::mapChr(unsigned window, unsigned count, unsigned bank)
+{
+    for (unsigned i = 0; i < count; ++i)
+	m_ppu->setPatternBank(window + i, bank * count + i);
+}
+
+// =====================================================================================================================
+void Mapper::setMirroring(Mirroring mirroring)
+{
+    m_ppu->setMirroring(mirroring);
+}
+
+// =====================================================================================================================
+unsigned Mapper::prgBanks(unsigned size) const
+{
+    return m_prg->size() / size;
+}
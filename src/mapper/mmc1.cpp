@@ -0,0 +1,97 @@
+#include <nemu/mapper/mmc1.h>
+
+// =====================================================================================================================
+MMC1::MMC1(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr)
+    : Mapper(prg, chr),
+      m_shift(0x10),
+      m_control(0x0c),
+      m_chrBank0(0),
+      m_chrBank1(0),
+      m_prgBank(0)
+{
+}
+
+// =====================================================================================================================
+void MMC1::writeRegister(uint16_t address, uint8_t data)
+{
+    // bit 7 resets the shift register and selects the PRG mode with the last bank fixed at $c000
+    if (data & 0x80)
+    {
+	m_shift = 0x10;
+	m_control |= 0x0c;
+	updateBanks();
+	return;
+    }
+
+    bool full = m_shift & 1;
+    m_shift = (m_shift >> 1) | ((data & 1) << 4);
+
+    if (!full)
+	return;
+
+    // the fifth write selects the register by its address
+    switch ((address >> 13) & 3)
+    {
+	case 0 : m_control = m_shift; break;
+	case 1 : m_chrBank0 = m_shift; break;
+	case 2 : m_chrBank1 = m_shift; break;
+	case 3 : m_prgBank = m_shift & 0x0f; break;
+    }
+
+    m_shift = 0x10;
+    updateBanks();
+}
+
+// =====================================================================================================================
+void MMC1::updateBanks()
+{
+    switch ((m_control >> 2) & 3)
+    {
+	case 0 :
+	case 1 :
+	    // 32kB mode ignores the low bit of the bank number
+	    mapPrg(0x8000, 0x8000, m_prgBank >> 1);
+	    break;
+
+	case 2 :
+	    mapPrg(0x8000, 0x4000, 0);
+	    mapPrg(0xc000, 0x4000, m_prgBank);
+	    break;
+
+	case 3 :
+	    mapPrg(0x8000, 0x4000, m_prgBank);
+	    mapPrg(0xc000, 0x4000, prgBanks(0x4000) - 1);
+	    break;
+    }
+
+    if (m_control & 0x10)
+    {
+	mapChr(0, 4, m_chrBank0);
+	mapChr(4, 4, m_chrBank1);
+    }
+    else
+	mapChr(0, 8, m_chrBank0 >> 1);
+
+    static const Mirroring s_mirroring[4] = {MIRROR_SINGLE_LOW, MIRROR_SINGLE_HIGH, MIRROR_VERTICAL, MIRROR_HORIZONTAL};
+    setMirroring(s_mirroring[m_control & 3]);
+}
+
+// =====================================================================================================================
+void MMC1::saveRegisters(StateWriter& writer) const
+{
+    writer.write(m_shift);
+    writer.write(m_control);
+    writer.write(m_chrBank0);
+    writer.write(m_chrBank1);
+    writer.write(m_prgBank);
+}
+
+// =====================================================================================================================
+void MMC1::loadRegisters(StateReader& reader)
+{
+    m_shift = reader.read<uint8_t>();
+    m_control = reader.read<uint8_t>();
+    m_chrBank0 = reader.read<uint8_t>();
+    m_chrBank1 = reader.read<uint8_t>();
+    m_prgBank = reader.read<uint8_t>();
+}
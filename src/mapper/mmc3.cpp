@@ -0,0 +1,144 @@
+#include <nemu/mapper/mmc3.h>
+#include <nemu/ppu.h>
+
+#include <string.h>
+
+// =====================================================================================================================
+MMC3::MMC3(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr)
+    : Mapper(prg, chr),
+      m_bankSelect(0),
+      m_mirroring(0),
+      m_prgRamProtect(0),
+      m_irqLatch(0),
+      m_irqCounter(0),
+      m_irqReload(false),
+      m_irqEnabled(false)
+{
+    memset(m_banks, 0, sizeof(m_banks));
+}
+
+// =====================================================================================================================
+void MMC3::attach(memory::Dispatcher& bus, PPU& ppu)
+{
+    Mapper::attach(bus, ppu);
+    ppu.setScanlineCallback(std::bind(&MMC3::scanline, this));
+}
+
+// =====================================================================================================================
+void MMC3::writeRegister(uint16_t address, uint8_t data)
+{
+    // each register pair is selected by the 8kB region and the lowest address bit
+    switch ((address & 0xe000) | (address & 1))
+    {
+	case 0x8000 :
+	    m_bankSelect = data;
+	    updateBanks();
+	    break;
+
+	case 0x8001 :
+	    m_banks[m_bankSelect & 7] = data;
+	    updateBanks();
+	    break;
+
+	case 0xa000 :
+	    m_mirroring = data;
+	    updateBanks();
+	    break;
+
+	case 0xa001 :
+	    m_prgRamProtect = data;
+	    break;
+
+	case 0xc000 :
+	    m_irqLatch = data;
+	    break;
+
+	case 0xc001 :
+	    m_irqCounter = 0;
+	    m_irqReload = true;
+	    break;
+
+	case 0xe000 :
+	    m_irqEnabled = false;
+	    break;
+
+	case 0xe001 :
+	    m_irqEnabled = true;
+	    break;
+    }
+}
+
+// =====================================================================================================================
+void MMC3::updateBanks()
+{
+    unsigned secondLast = prgBanks(0x2000) - 2;
+
+    // bit 6 swaps the switchable bank at $8000 with the fixed second last bank at $c000
+    if (m_bankSelect & 0x40)
+    {
+	mapPrg(0x8000, 0x2000, secondLast);
+	mapPrg(0xc000, 0x2000, m_banks[6]);
+    }
+    else
+    {
+	mapPrg(0x8000, 0x2000, m_banks[6]);
+	mapPrg(0xc000, 0x2000, secondLast);
+    }
+
+    mapPrg(0xa000, 0x2000, m_banks[7]);
+    mapPrg(0xe000, 0x2000, secondLast + 1);
+
+    // bit 7 swaps the 2kB banks at $0000 with the 1kB banks at $1000
+    unsigned first = (m_bankSelect & 0x80) ? 4 : 0;
+    unsigned second = first ^ 4;
+
+    mapChr(first + 0, 2, m_banks[0] >> 1);
+    mapChr(first + 2, 2, m_banks[1] >> 1);
+    mapChr(second + 0, 1, m_banks[2]);
+    mapChr(second + 1, 1, m_banks[3]);
+    mapChr(second + 2, 1, m_banks[4]);
+    mapChr(second + 3, 1, m_banks[5]);
+
+    setMirroring((m_mirroring & 1) ? MIRROR_HORIZONTAL : MIRROR_VERTICAL);
+}
+
+// =====================================================================================================================
+void MMC3::scanline()
+{
+    if (m_irqCounter == 0 || m_irqReload)
+    {
+	m_irqCounter = m_irqLatch;
+	m_irqReload = false;
+    }
+    else
+	--m_irqCounter;
+
+    if (m_irqCounter == 0 && m_irqEnabled && m_irqCallback)
+	m_irqCallback();
+}
+
+// =====================================================================================================================
+void MMC3::saveRegisters(StateWriter& writer) const
+{
+    writer.write(m_bankSelect);
+    writer.write(m_banks, sizeof(m_banks));
+    writer.write(m_mirroring);
+    writer.write(m_prgRamProtect);
+    writer.write(m_irqLatch);
+    writer.write(m_irqCounter);
+    writer.write(m_irqReload);
+    writer.write(m_irqEnabled);
+}
+
+// =====================================================================================================================
+void MMC3::loadRegisters(StateReader& reader)
+{
+    m_bankSelect = reader.read<uint8_t>();
+    reader.read(m_banks, sizeof(m_banks));
+    m_mirroring = reader.read<uint8_t>();
+    m_prgRamProtect = reader.read<uint8_t>();
+    m_irqLatch = reader.read<uint8_t>();
+    m_irqCounter = reader.read<uint8_t>();
+    m_irqReload = reader.read<bool>();
+    m_irqEnabled = reader.read<bool>();
+}
@@ -0,0 +1,31 @@
+#include <nemu/mapper/nrom.h>
+
+// =====================================================================================================================
+NROM::NROM(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr)
+    : Mapper(prg, chr)
+{
+}
+
+// =====================================================================================================================
+void NROM::writeRegister(uint16_t address, uint8_t data)
+{
+    // there are no registers, writes to the ROM are ignored
+}
+
+// =====================================================================================================================
+void NROM::updateBanks()
+{
+    // 16kB images are mirrored at $c000
+    mapPrg(0x8000, 0x8000, 0);
+    mapChr(0, 8, 0);
+}
+
+// =====================================================================================================================
+void NROM::saveRegisters(StateWriter& writer) const
+{
+}
+
+// =====================================================================================================================
+void NROM::loadRegisters(StateReader& reader)
+{
+}
@@ -0,0 +1,35 @@
+#include <nemu/mapper/uxrom.h>
+
+// =====================================================================================================================
+UxROM::UxROM(const std::shared_ptr<memory::ROM>& prg, const std::shared_ptr<memory::ROM>& chr)
+    : Mapper(prg, chr),
+      m_prgBank(0)
+{
+}
+
+// =====================================================================================================================
+void UxROM::writeRegister(uint16_t address, uint8_t data)
+{
+    m_prgBank = data;
+    mapPrg(0x8000, 0x4000, m_prgBank);
+}
+
+// =====================================================================================================================
+void UxROM::updateBanks()
+{
+    mapPrg(0x8000, 0x4000, m_prgBank);
+    mapPrg(0xc000, 0x4000, prgBanks(0x4000) - 1);
+    mapChr(0, 8, 0);
+}
+
+// =====================================================================================================================
+void UxROM::saveRegisters(StateWriter& writer) const
+{
+    writer.write(m_prgBank);
+}
+
+// =====================================================================================================================
+void UxROM::loadRegisters(StateReader& reader)
+{
+    m_prgBank = reader.read<uint8_t>();
+}
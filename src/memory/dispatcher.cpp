@@ -1,10 +1,24 @@
 #include <nemu/memory/dispatcher.h>
+#include <nemu/memory/ram.h>
+#include <nemu/memory/rom.h>
 
 #include <iomanip>
 #include <iostream>
+#include <typeinfo>
 
 using memory::Dispatcher;
 
+// =====================================================================================================================
+Dispatcher::Dispatcher()
+{
+    for (unsigned i = 0; i < 256; ++i)
+    {
+	m_readPages[i] = nullptr;
+	m_writePages[i] = nullptr;
+	m_mappedPages[i] = false;
+    }
+}
+
 // =====================================================================================================================
 void Dispatcher::registerHandler(uint16_t address, const std::shared_ptr<lib6502::Memory>& handler)
 {
@@ -15,27 +29,141 @@ void Dispatcher::registerHandler(uint16_t address, const std::shared_ptr<lib6502
 void Dispatcher::registerHandler(uint16_t address, uint16_t size, const std::shared_ptr<lib6502::Memory>& handler)
 {
     m_handlers.push_back({address, size, handler});
+
+    if (size == 0)
+	return;
+
+    unsigned first = address >> 8;
+    unsigned last = (address + size - 1) >> 8;
+
+    for (unsigned page = first; page <= last && page < 256; ++page)
+	updatePage(page);
+}
+
+// =====================================================================================================================
+void Dispatcher::mapPages(uint16_t address, unsigned size, const uint8_t* readData, uint8_t* writeData)
+{
+    unsigned first = address >> 8;
+    unsigned count = size >> 8;
+
+    for (unsigned i = 0; i < count && first + i < 256; ++i)
+    {
+	unsigned page = first + i;
+
+	m_mappedPages[page] = true;
+	m_readPages[page] = readData ? readData + i * 0x100 : nullptr;
+	m_writePages[page] = writeData ? writeData + i * 0x100 : nullptr;
+    }
 }
 
 // =====================================================================================================================
 uint8_t Dispatcher::read(uint16_t address)
 {
+    const uint8_t* page = m_readPages[address >> 8];
+
+    if (page)
+	return page[address & 0xff];
+
     const auto& h = findHandler(address);
     return h.m_handler->read(address - h.m_base);
 }
 
+// =====================================================================================================================
+uint8_t Dispatcher::peek(uint16_t address) const
+{
+    const uint8_t* page = m_readPages[address >> 8];
+
+    return page ? page[address & 0xff] : 0;
+}
+
+// =====================================================================================================================
+const uint8_t* Dispatcher::readPage(unsigned page) const
+{
+    return m_readPages[page];
+}
+
 // =====================================================================================================================
 void Dispatcher::write(uint16_t address, uint8_t data)
 {
+    uint8_t* page = m_writePages[address >> 8];
+
+    if (page)
+    {
+	page[address & 0xff] = data;
+	return;
+    }
+
     const auto& h = findHandler(address);
     h.m_handler->write(address - h.m_base, data);
 }
 
+// =====================================================================================================================
+void Dispatcher::updatePage(unsigned page)
+{
+    unsigned base = page << 8;
+
+    m_pageHandlers[page].clear();
+
+    // collect the handlers overlapping this page in registration order
+    for (unsigned i = 0; i < m_handlers.size(); ++i)
+    {
+	const Handler& h = m_handlers[i];
+
+	if (h.m_size == 0)
+	    continue;
+
+	if ((h.m_base <= base + 0xff) && (base <= h.m_base + h.m_size - 1u))
+	    m_pageHandlers[page].push_back(i);
+    }
+
+    // the pointers of mapped pages are owned by mapPages()
+    if (m_mappedPages[page])
+	return;
+
+    m_readPages[page] = nullptr;
+    m_writePages[page] = nullptr;
+
+    if (m_pageHandlers[page].empty())
+	return;
+
+    // the page can be accessed directly only if the first matching handler covers all of it
+    const Handler& h = m_handlers[m_pageHandlers[page].front()];
+
+    if ((h.m_base > base) || (h.m_base + h.m_size < base + 0x100u))
+	return;
+
+    unsigned offset = base - h.m_base;
+    lib6502::Memory& memory = *h.m_handler;
+
+    // Only exact RAM and ROM instances are mapped directly, subclasses (e.g. the palette memory) may translate the
+    // address so they have to go through their handler.
+    if (typeid(memory) == typeid(RAM))
+    {
+	RAM& ram = static_cast<RAM&>(memory);
+
+	if (offset + 0x100 <= ram.size())
+	{
+	    m_readPages[page] = ram.data() + offset;
+	    m_writePages[page] = ram.data() + offset;
+	}
+    }
+    else if (typeid(memory) == typeid(ROM))
+    {
+	ROM& rom = static_cast<ROM&>(memory);
+
+	// writes are still passed to the ROM to report the invalid access
+	if (offset + 0x100 <= rom.size())
+	    m_readPages[page] = rom.data() + offset;
+    }
+}
+
 // =====================================================================================================================
 const Dispatcher::Handler& Dispatcher::findHandler(uint16_t address)
 {
-    for (const auto& h : m_handlers)
+    for (unsigned i : m_pageHandlers[address >> 8])
     {
+	const Handler& h = m_handlers[i];
+
 	if ((h.m_base <= address) && (address <= (h.m_base + h.m_size - 1)))
 	    return h;
     }
@@ -0,0 +1,70 @@
+#include <nemu/memory/mappedfile.h>
+
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using memory::MappedFile;
+
+// =====================================================================================================================
+MappedFile::MappedFile(const std::string& file)
+    : m_data(nullptr),
+      m_size(0)
+{
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+	throw std::system_error(errno, std::system_category(), file);
+
+    struct stat st;
+
+    if (::fstat(fd, &st) != 0)
+    {
+	int error = errno;
+	::close(fd);
+	throw std::system_error(error, std::system_category(), file);
+    }
+
+    m_size = st.st_size;
+
+    // an empty file can not be mapped, it is left to the caller to reject it
+    if (m_size > 0)
+    {
+	void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	if (data == MAP_FAILED)
+	{
+	    int error = errno;
+	    ::close(fd);
+	    throw std::system_error(error, std::system_category(), file);
+	}
+
+	m_data = static_cast<const uint8_t*>(data);
+    }
+
+    // the mapping stays valid without the descriptor
+    ::close(fd);
+}
+
+// =====================================================================================================================
+MappedFile::~MappedFile()
+{
+    if (m_data)
+	::munmap(const_cast<uint8_t*>(m_data), m_size);
+}
+
+// =====================================================================================================================
+const uint8_t* MappedFile::data() const
+{
+    return m_data;
+}
+
+// =====================================================================================================================
+size_t MappedFile::size() const
+{
+    return m_size;
+}
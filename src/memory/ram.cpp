@@ -6,7 +6,7 @@ using memory::RAM;
 
 // =====================================================================================================================
 RAM::RAM(unsigned size)
-    : m_data(new uint8_t[size]),
+    : m_data(new uint8_t[size]()),
       m_size(size)
 {
 }
@@ -23,6 +23,28 @@ unsigned RAM::size() const
     return m_size;
 }
 
+// =====================================================================================================================
+uint8_t* RAM::data()
+{
+    return m_data;
+}
+
+// =====================================================================================================================
+void RAM::saveState(StateWriter& writer) const
+{
+    writer.write(m_size);
+    writer.write(m_data, m_size);
+}
+
+// =====================================================================================================================
+void RAM::loadState(StateReader& reader)
+{
+    if (reader.read<unsigned>() != m_size)
+	throw StateException("RAM size mismatch");
+
+    reader.read(m_data, m_size);
+}
+
 // =====================================================================================================================
 uint8_t RAM::read(uint16_t address)
 {
@@ -7,14 +7,17 @@ using memory::ROM;
 // =====================================================================================================================
 ROM::ROM(uint8_t* data, unsigned size)
     : m_data(data),
-      m_size(size)
+      m_size(size),
+      m_backing(data, std::default_delete<uint8_t[]>())
 {
 }
 
 // =====================================================================================================================
-ROM::~ROM()
+ROM::ROM(const uint8_t* data, unsigned size, const std::shared_ptr<const void>& backing)
+    : m_data(data),
+      m_size(size),
+      m_backing(backing)
 {
-    delete[] m_data;
 }
 
 // =====================================================================================================================
@@ -23,6 +26,12 @@ unsigned ROM::size() const
     return m_size;
 }
 
+// =====================================================================================================================
+const uint8_t* ROM::data() const
+{
+    return m_data;
+}
+
 // =====================================================================================================================
 uint8_t ROM::read(uint16_t address)
 {
@@ -33,5 +42,5 @@ uint8_t ROM::read(uint16_t address)
 // =====================================================================================================================
 void ROM::write(uint16_t address, uint8_t data)
 {
-    throw "trying to write ROM";
+    throw WriteException(address);
 }
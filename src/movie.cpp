@@ -0,0 +1,151 @@
+#include <nemu/movie.h>
+#include <nemu/state.h>
+
+static const char s_movieMagic[4] = {'N', 'M', 'O', 'V'};
+static const uint32_t s_movieVersion = 1;
+
+// =====================================================================================================================
+static void writeLength(StateWriter& writer, unsigned length)
+{
+    // 7 bits per byte, the high bit marks that more bytes follow
+    while (length >= 0x80)
+    {
+	writer.write(uint8_t((length & 0x7f) | 0x80));
+	length >>= 7;
+    }
+
+    writer.write(uint8_t(length));
+}
+
+// =====================================================================================================================
+static unsigned readLength(StateReader& reader)
+{
+    unsigned length = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+
+    do
+    {
+	byte = reader.read<uint8_t>();
+
+	if (shift > 28)
+	    throw StateException("invalid run length in movie");
+
+	length |= unsigned(byte & 0x7f) << shift;
+	shift += 7;
+    }
+    while (byte & 0x80);
+
+    return length;
+}
+
+// =====================================================================================================================
+Movie::Movie(uint32_t romCrc, unsigned startFrame)
+    : m_romCrc(romCrc),
+      m_startFrame(startFrame)
+{
+}
+
+// =====================================================================================================================
+uint32_t Movie::romCrc() const
+{
+    return m_romCrc;
+}
+
+// =====================================================================================================================
+unsigned Movie::startFrame() const
+{
+    return m_startFrame;
+}
+
+// =====================================================================================================================
+unsigned Movie::length() const
+{
+    return m_inputs.size();
+}
+
+// =====================================================================================================================
+void Movie::record(unsigned frame, uint8_t buttons)
+{
+    // frames before the start of the recording can only be reached by loading an older state, they are not recorded
+    if (frame < m_startFrame)
+	return;
+
+    m_inputs.resize(frame - m_startFrame);
+    m_inputs.push_back(buttons);
+}
+
+// =====================================================================================================================
+bool Movie::input(unsigned frame, uint8_t& buttons) const
+{
+    if (frame < m_startFrame || frame - m_startFrame >= m_inputs.size())
+	return false;
+
+    buttons = m_inputs[frame - m_startFrame];
+
+    return true;
+}
+
+// =====================================================================================================================
+void Movie::save(std::vector<uint8_t>& buffer) const
+{
+    buffer.clear();
+
+    StateWriter writer(buffer);
+
+    writer.write(s_movieMagic, sizeof(s_movieMagic));
+    writer.write(s_movieVersion);
+    writer.write(m_romCrc);
+    writer.write(uint32_t(m_startFrame));
+    writer.write(uint32_t(m_inputs.size()));
+
+    // runs of equal inputs as (length, buttons) pairs
+    for (size_t i = 0; i < m_inputs.size(); )
+    {
+	size_t end = i + 1;
+
+	while (end < m_inputs.size() && m_inputs[end] == m_inputs[i])
+	    ++end;
+
+	writeLength(writer, end - i);
+	writer.write(m_inputs[i]);
+
+	i = end;
+    }
+}
+
+// =====================================================================================================================
+void Movie::load(const std::vector<uint8_t>& buffer)
+{
+    StateReader reader(buffer.data(), buffer.size());
+
+    char magic[4];
+    reader.read(magic, sizeof(magic));
+
+    if (memcmp(magic, s_movieMagic, sizeof(magic)) != 0)
+	throw StateException("not a movie file");
+
+    if (reader.read<uint32_t>() != s_movieVersion)
+	throw StateException("unsupported movie version");
+
+    m_romCrc = reader.read<uint32_t>();
+    m_startFrame = reader.read<uint32_t>();
+
+    uint32_t length = reader.read<uint32_t>();
+
+    m_inputs.clear();
+
+    while (m_inputs.size() < length)
+    {
+	unsigned run = readLength(reader);
+	uint8_t buttons = reader.read<uint8_t>();
+
+	if (run == 0 || run > length - m_inputs.size())
+	    throw StateException("invalid run length in movie");
+
+	m_inputs.insert(m_inputs.end(), run, buttons);
+    }
+
+    if (!reader.atEnd())
+	throw StateException("trailing data in movie");
+}
@@ -1 +1,290 @@
 #include <nemu/nemu.h>
+#include <nemu/machine.h>
+#include <nemu/workpool.h>
+
+// No exception may cross the C interface, every entry point catches all of them and reports them as errors.
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct nemu_instance
+{
+    std::shared_ptr<Loader> m_cartridge;
+    std::unique_ptr<Machine> m_machine;
+
+    /// the buttons the game reads during a step
+    uint8_t m_buttons;
+
+    /// reused for saving states to avoid allocations
+    std::vector<uint8_t> m_stateBuffer;
+
+    std::string m_error;
+};
+
+// =====================================================================================================================
+static WorkPool& batchPool()
+{
+    static WorkPool s_pool(0);
+    return s_pool;
+}
+
+// =====================================================================================================================
+static int fail(nemu_instance* instance, const std::string& error)
+{
+    instance->m_error = error;
+    return -1;
+}
+
+// =====================================================================================================================
+static void powerOn(nemu_instance* instance)
+{
+    instance->m_machine.reset(new Machine(*instance->m_cartridge));
+
+    PPU& ppu = instance->m_machine->ppu();
+    ppu.setIndexOutput(true);
+
+    // the buttons are given per step, the live input of the controller is not used
+    instance->m_machine->gamepad()->setInputCallback([instance]() { return instance->m_buttons; });
+}
+
+// =====================================================================================================================
+nemu_instance* nemu_create(void)
+{
+    try
+    {
+	nemu_instance* instance = new nemu_instance();
+	instance->m_buttons = 0;
+	return instance;
+    }
+    catch (...)
+    {
+	return nullptr;
+    }
+}
+
+// =====================================================================================================================
+void nemu_destroy(nemu_instance* instance)
+{
+    delete instance;
+}
+
+// =====================================================================================================================
+int nemu_load_rom(nemu_instance* instance, const char* file)
+{
+    try
+    {
+	std::shared_ptr<Loader> cartridge = std::make_shared<Loader>();
+	cartridge->load(file);
+
+	instance->m_cartridge = cartridge;
+	powerOn(instance);
+    }
+    catch (const std::exception& e)
+    {
+	instance->m_machine.reset();
+	return fail(instance, e.what());
+    }
+    catch (...)
+    {
+	instance->m_machine.reset();
+	return fail(instance, "unknown error");
+    }
+
+    return 0;
+}
+
+// =====================================================================================================================
+int nemu_reset(nemu_instance* instance)
+{
+    if (!instance->m_cartridge)
+	return fail(instance, "no ROM loaded");
+
+    try
+    {
+	powerOn(instance);
+    }
+    catch (const std::exception& e)
+    {
+	instance->m_machine.reset();
+	return fail(instance, e.what());
+    }
+    catch (...)
+    {
+	instance->m_machine.reset();
+	return fail(instance, "unknown error");
+    }
+
+    return 0;
+}
+
+// =====================================================================================================================
+int nemu_step(nemu_instance* instance, unsigned frames, uint8_t buttons)
+{
+    if (!instance->m_machine)
+	return fail(instance, "no ROM loaded");
+
+    Machine& machine = *instance->m_machine;
+    PPU& ppu = machine.ppu();
+
+    instance->m_buttons = buttons;
+
+    try
+    {
+	// frames nobody looks at only evaluate the status flags the game sees
+	for (unsigned i = 0; i < frames; ++i)
+	{
+	    ppu.setVideoOutput(i + 1 == frames);
+	    machine.runFrame();
+	}
+    }
+    catch (const std::exception& e)
+    {
+	return fail(instance, e.what());
+    }
+    catch (...)
+    {
+	return fail(instance, "unknown error");
+    }
+
+    return 0;
+}
+
+// =====================================================================================================================
+int nemu_step_batch(nemu_instance* const* instances, const uint8_t* buttons, size_t count, unsigned frames)
+{
+    WorkPool& pool = batchPool();
+
+    // other threads may step their own batches on the pool at the same time
+    WorkPool::TaskGroup group;
+    std::vector<int> results;
+
+    try
+    {
+	// one task per worker with a contiguous range of instances keeps the scheduling cost per step low
+	size_t tasks = std::min<size_t>(pool.threads(), count);
+	results.assign(tasks, 0);
+
+	for (size_t t = 0; t < tasks; ++t)
+	{
+	    size_t first = count * t / tasks;
+	    size_t last = count * (t + 1) / tasks;
+	    int* result = &results[t];
+
+	    pool.submit(group, [=]() {
+		for (size_t i = first; i < last; ++i)
+		{
+		    if (nemu_step(instances[i], frames, buttons[i]) != 0)
+			*result = -1;
+		}
+	    });
+	}
+    }
+    catch (...)
+    {
+	// the tasks already queued refer to the results
+	pool.wait(group);
+	return -1;
+    }
+
+    pool.wait(group);
+
+    return std::find(results.begin(), results.end(), -1) == results.end() ? 0 : -1;
+}
+
+// =====================================================================================================================
+const uint32_t* nemu_frame_rgb(const nemu_instance* instance)
+{
+    return instance->m_machine ? instance->m_machine->ppu().frameBuffer() : nullptr;
+}
+
+// =====================================================================================================================
+const uint8_t* nemu_frame_indices(const nemu_instance* instance)
+{
+    return instance->m_machine ? instance->m_machine->ppu().indexFrame() : nullptr;
+}
+
+// =====================================================================================================================
+const uint8_t* nemu_ram(const nemu_instance* instance)
+{
+    return instance->m_machine ? instance->m_machine->ram() : nullptr;
+}
+
+// =====================================================================================================================
+unsigned nemu_frame_count(const nemu_instance* instance)
+{
+    return instance->m_machine ? instance->m_machine->ppu().frameCount() : 0;
+}
+
+// =====================================================================================================================
+int nemu_save_state(nemu_instance* instance, void* buffer, size_t* size)
+{
+    if (!instance->m_machine)
+	return fail(instance, "no ROM loaded");
+
+    try
+    {
+	instance->m_machine->saveState(instance->m_stateBuffer);
+    }
+    catch (const std::exception& e)
+    {
+	return fail(instance, e.what());
+    }
+    catch (...)
+    {
+	return fail(instance, "unknown error");
+    }
+
+    size_t available = *size;
+    *size = instance->m_stateBuffer.size();
+
+    if (!buffer || available < instance->m_stateBuffer.size())
+	return fail(instance, "state buffer too small");
+
+    memcpy(buffer, instance->m_stateBuffer.data(), instance->m_stateBuffer.size());
+
+    return 0;
+}
+
+// =====================================================================================================================
+int nemu_load_state(nemu_instance* instance, const void* buffer, size_t size)
+{
+    if (!instance->m_machine)
+	return fail(instance, "no ROM loaded");
+
+    const uint8_t* data = static_cast<const uint8_t*>(buffer);
+    std::vector<uint8_t> state(data, data + size);
+    std::vector<uint8_t> previous;
+
+    try
+    {
+	instance->m_machine->saveState(previous);
+	instance->m_machine->loadState(state);
+    }
+    catch (const std::exception& e)
+    {
+	// a state failing half way leaves the machine inconsistent
+	if (!previous.empty())
+	    instance->m_machine->loadState(previous);
+
+	return fail(instance, e.what());
+    }
+    catch (...)
+    {
+	if (!previous.empty())
+	    instance->m_machine->loadState(previous);
+
+	return fail(instance, "unknown error");
+    }
+
+    return 0;
+}
+
+// =====================================================================================================================
+const char* nemu_last_error(const nemu_instance* instance)
+{
+    return instance->m_error.c_str();
+}
@@ -1,188 +1,722 @@
 #include <nemu/nesemulator.h>
 #include <nemu/loader.h>
-#include <nemu/ppu.h>
-#include <nemu/memory/ram.h>
-
-#include <lib6502/cpu.h>
+#include <nemu/cputrace.h>
+#include <nemu/profiler.h>
 
 #include <SDL/SDL.h>
 
 #include <iostream>
 #include <iomanip>
 
-static uint64_t s_tick = 0;
+#include <fstream>
+#include <iterator>
+#include <system_error>
 
-// =====================================================================================================================
-class CpuTracer : public lib6502::InstructionTracer
-{
-    public:
-	void trace(const lib6502::Cpu::State& state, const std::string& inst) override
-	{
-	    std::cerr << std::hex;
-	    std::cerr << "t=" << std::setw(8) << std::setfill('0') << s_tick << " ";
-	    std::cerr << "CPU [";
-	    std::cerr << "PC=" << std::setw(4) << std::setfill('0') << state.m_PC << " ";
-	    std::cerr << "A=" << std::setw(2) << std::setfill('0') << (int)state.m_A << " ";
-	    std::cerr << "X=" << std::setw(2) << std::setfill('0') << (int)state.m_X << " ";
-	    std::cerr << "Y=" << std::setw(2) << std::setfill('0') << (int)state.m_Y << " ";
-	    std::cerr << "S=" << std::setw(2) << std::setfill('0') << (int)state.m_status << " ";
-	    std::cerr << "SP=" << std::setw(2) << std::setfill('0') << (int)state.m_SP << " ";
-	    std::cerr << "int=" << (state.m_inInterrupt ? "Y" : "N");
-	    std::cerr << "] ";
-	    std::cerr << inst;
-	    std::cerr << std::endl;
-	}
-};
-
-// =====================================================================================================================
-class SpriteDMA : public lib6502::Memory
-{
-    public:
-	SpriteDMA(memory::Dispatcher& memory, lib6502::Memory& spriteRam)
-	    : m_memory(memory),
-	      m_spriteRam(spriteRam)
-	{}
-
-	uint8_t read(uint16_t address) override
-	{ abort(); }
-
-	void write(uint16_t address, uint8_t data) override
-	{
-	    uint16_t base = data * 0x100;
-
-	    for (unsigned i = 0; i < 64 * 4; ++i)
-		m_spriteRam.write(i, m_memory.read(base + i));
-	}
-
-    private:
-	memory::Dispatcher& m_memory;
-	lib6502::Memory& m_spriteRam;
-};
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
 
 // =====================================================================================================================
 NesEmulator::NesEmulator()
-    : m_running(true)
+    : m_running(true),
+      m_headless(false),
+      m_frameLimit(0),
+      m_timeLimit(0),
+      m_renderThreads(0),
+      m_speed(1.0),
+      m_turbo(false),
+      m_frameSkip(0),
+      m_skipped(0),
+      m_skipping(false),
+      m_lastRendered(0),
+      m_movieInput(0),
+      m_traceRecords(1 << 20),
+      m_traceFirst(0x0000),
+      m_traceLast(0xffff),
+      m_traceTrigger(-1),
+      m_runAhead(0),
+      m_rewindBudget(64),
+      m_rewindInterval(1),
+      m_rewinding(false),
+      m_romCrc(0),
+      m_firstFrame(0)
 {
 }
 
 // =====================================================================================================================
 int NesEmulator::run(int argc, char** argv)
 {
-    if (argc != 2)
+    if (!parseArguments(argc, argv))
+    {
+	std::cerr << "Usage: " << argv[0] << " [--headless] [--frames N] [--seconds S] [--render-threads N] [--speed X] [--turbo] [--frameskip N|auto] [--load-state F] [--save-state F] [--rewind-budget MB] [--rewind-interval N] [--run-ahead N] [--record-movie F | --play-movie F] [--trace F] [--trace-records N] [--trace-pc FIRST-LAST] [--trace-trigger ADDR] [--record F] rom" << std::endl;
 	return 1;
+    }
 
-    SDL_Init(SDL_INIT_EVERYTHING);
+    // the video subsystem is initialised by the presenter thread
+    if (!m_headless)
+	SDL_Init(0);
 
-    if (!loadCartridge(argv[1]))
+    if (!loadCartridge(m_cartridge))
     {
-	std::cerr << "Unable to load cartridge: " << argv[1] << std::endl;
+	std::cerr << "Unable to load cartridge: " << m_cartridge << std::endl;
 	return 1;
     }
 
-    // register 2kB system memory
-    std::shared_ptr<memory::RAM> ram(new memory::RAM(0x800));
-    for (unsigned i = 0; i < 4; ++i)
-	m_memory.registerHandler(i * 0x800, 0x800, ram);
+    PPU& ppu = m_machine->ppu();
+
+    if (!m_headless)
+    {
+	m_presenter.reset(new Presenter(m_machine->gamepad()));
+	ppu.setFrameCallback(std::bind(&Presenter::submit, m_presenter.get(), std::placeholders::_1));
+
+	// the emulator stays usable without sound
+	try
+	{
+	    m_audio.reset(new AudioOutput());
+	    m_machine->apu().setSampleCallback(std::bind(&AudioOutput::submit, m_audio.get(), std::placeholders::_1,
+							 std::placeholders::_2));
+	}
+	catch (const AudioException& e)
+	{
+	    std::cerr << "Audio disabled: " << e.what() << std::endl;
+	}
+    }
+
+    ppu.setRenderThreads(m_renderThreads);
+
+    if (!m_traceFile.empty())
+    {
+	try
+	{
+	    m_trace.reset(new CpuTrace(m_traceFile, m_traceRecords, m_machine->bus(), m_machine->cycles()));
+	}
+	catch (const std::system_error& e)
+	{
+	    std::cerr << "Unable to create trace: " << e.what() << std::endl;
+	    return 1;
+	}
+
+	m_trace->setRange(m_traceFirst, m_traceLast);
+
+	if (m_traceTrigger >= 0)
+	    m_trace->setTrigger(m_traceTrigger);
+
+	m_machine->cpu().setTracer(m_trace.get());
+    }
+
+    if (!m_videoFile.empty())
+    {
+	try
+	{
+	    m_recorder.reset(new VideoRecorder(m_videoFile));
+	}
+	catch (const std::system_error& e)
+	{
+	    std::cerr << "Unable to create video: " << e.what() << std::endl;
+	    return 1;
+	}
 
-    m_cpu.reset(new lib6502::Cpu(m_memory));
+	ppu.setIndexOutput(true);
+    }
 
-    // register PPU mappnigs
-    m_memory.registerHandler(0x2000, 8, m_ppu);
-    m_ppu->setNmiCallback(std::bind(&NesEmulator::frameComplete, this));
+    if (!m_loadStateFile.empty() && !loadStateFile(m_loadStateFile))
+	return 1;
 
-    // register gamepad
-    m_gamepad.reset(new GamePad());
-    m_memory.registerHandler(0x4016, 2, m_gamepad);
+    if (!startMovie())
+	return 1;
 
-    // register sprite DMA engine
-    m_memory.registerHandler(0x4014, 1, std::make_shared<SpriteDMA>(m_memory, *m_ppu->spriteRam()));
+    // rewinding is interactive only
+    if (!m_headless && m_rewindBudget != 0)
+	m_rewind.reset(new RewindBuffer(m_rewindBudget * 1024 * 1024, 60));
 
-    // register APU registers
-    m_memory.registerHandler(0x4000, 0x14, std::make_shared<memory::RAM>(0x14));
-    m_memory.registerHandler(0x4015, 0x1, std::make_shared<memory::RAM>(0x1));
+    m_firstFrame = ppu.frameCount();
+    m_startTime = FramePacer::now();
+    m_pacer.setSpeed(m_speed);
 
     try
     {
 	while (m_running)
 	{
-	    m_ppu->tick();
-	    m_ppu->tick();
-	    m_ppu->tick();
-	    m_cpu->tick();
+	    // a rewound frame is emulated again from its saved state so it is presented the normal way
+	    if (m_rewinding && m_rewind->pop(m_stateBuffer))
+		m_machine->loadState(m_stateBuffer);
+
+	    if (m_movie)
+	    {
+		updateMovieInput();
+
+		if (!m_running)
+		    break;
+	    }
+
+	    if (m_frameSkip != 0)
+	    {
+		m_skipping = skipFrame();
+		m_machine->ppu().setVideoOutput(!m_skipping);
+	    }
+
+	    // nothing of a skipped frame is presented, so there is nothing to run ahead for
+	    if (m_runAhead != 0 && !m_rewinding && !m_skipping)
+		runAheadFrame();
+	    else
+		m_machine->runFrame();
+
+	    frameComplete();
+
+	    NEMU_PROFILE_END_FRAME();
 	}
     }
     catch (const memory::Dispatcher::InvalidAddressException& e)
     {
 	std::cerr << "Invalid memory access at $" << std::hex << e.getAddress() << std::endl;
     }
+    catch (const memory::ROM::WriteException& e)
+    {
+	std::cerr << "ROM write at offset $" << std::hex << e.getAddress() << std::endl;
+	std::cerr << "PC=" << std::hex << m_machine->cpu().getState().m_PC << std::endl;
+	return 1;
+    }
     catch (const PPUException& e)
     {
 	std::cerr << "PPU error: " << e.what() << std::endl;
-	std::cerr << "PC=" << std::hex << m_cpu->getState().m_PC << std::endl;
+	std::cerr << "PC=" << std::hex << m_machine->cpu().getState().m_PC << std::endl;
 	return 1;
     }
     catch (const lib6502::CpuException& e)
     {
 	std::cerr << "CPU error: " << e.what() << std::endl;
-	std::cerr << "PC=" << std::hex << m_cpu->getState().m_PC << std::endl;
+	std::cerr << "PC=" << std::hex << m_machine->cpu().getState().m_PC << std::endl;
 	return 1;
     }
 
-    SDL_Quit();
+    if (!m_saveStateFile.empty() && !saveStateFile(m_saveStateFile))
+	return 1;
+
+    if (!m_recordMovieFile.empty() && !saveMovieFile(m_recordMovieFile))
+	return 1;
+
+    if (m_recorder)
+    {
+	m_recorder->finish();
+
+	// stdout is reserved for the statistics
+	std::cerr << "Recorded " << m_recorder->frames() << " frames to " << m_videoFile << ", "
+		  << m_recorder->dropped() << " dropped" << std::endl;
+
+	if (m_recorder->error() != 0)
+	{
+	    std::cerr << "Unable to write video: " << std::system_category().message(m_recorder->error()) << std::endl;
+	    return 1;
+	}
+    }
+
+    if (m_headless)
+	printStatistics();
+    else
+    {
+	m_presenter.reset();
+
+	if (m_audio)
+	{
+	    std::cout << "Audio underruns: " << m_audio->underruns() << std::endl;
+	    m_audio.reset();
+	}
+
+	SDL_Quit();
+
+	std::cout << "Missed frame deadlines: " << m_pacer.missedDeadlines()
+		  << " (worst " << m_pacer.maxLateness() / 1000000.0 << " ms late)" << std::endl;
+    }
+
+    NEMU_PROFILE_DUMP();
 
     return 0;
 }
 
+// =====================================================================================================================
+bool NesEmulator::parseArguments(int argc, char** argv)
+{
+    static const option options[] = {
+	{"headless", no_argument, nullptr, 'H'},
+	{"frames", required_argument, nullptr, 'f'},
+	{"seconds", required_argument, nullptr, 's'},
+	{"render-threads", required_argument, nullptr, 'r'},
+	{"speed", required_argument, nullptr, 'S'},
+	{"turbo", no_argument, nullptr, 'T'},
+	{"frameskip", required_argument, nullptr, 'k'},
+	{"load-state", required_argument, nullptr, 'l'},
+	{"save-state", required_argument, nullptr, 'w'},
+	{"rewind-budget", required_argument, nullptr, 'b'},
+	{"rewind-interval", required_argument, nullptr, 'i'},
+	{"run-ahead", required_argument, nullptr, 'a'},
+	{"record-movie", required_argument, nullptr, 'm'},
+	{"play-movie", required_argument, nullptr, 'p'},
+	{"trace", required_argument, nullptr, 't'},
+	{"trace-records", required_argument, nullptr, 'n'},
+	{"trace-pc", required_argument, nullptr, 'c'},
+	{"trace-trigger", required_argument, nullptr, 'g'},
+	{"record", required_argument, nullptr, 'v'},
+	{nullptr, 0, nullptr, 0}
+    };
+
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1)
+    {
+	switch (opt)
+	{
+	    case 'H' :
+		m_headless = true;
+		break;
+
+	    case 'f' :
+		m_frameLimit = strtoul(optarg, nullptr, 10);
+		break;
+
+	    case 's' :
+		m_timeLimit = strtod(optarg, nullptr);
+		break;
+
+	    case 'r' :
+		m_renderThreads = strtoul(optarg, nullptr, 10);
+		break;
+
+	    case 'S' :
+		m_speed = strtod(optarg, nullptr);
+
+		if (m_speed < FramePacer::MIN_SPEED || m_speed > FramePacer::MAX_SPEED)
+		    return false;
+
+		break;
+
+	    case 'T' :
+		m_turbo = true;
+		break;
+
+	    case 'k' :
+	    {
+		if (strcmp(optarg, "auto") == 0)
+		{
+		    m_frameSkip = AUTO_FRAME_SKIP;
+		    break;
+		}
+
+		char* end;
+		unsigned long frames = strtoul(optarg, &end, 10);
+
+		if (*end != '\0' || frames > 59)
+		    return false;
+
+		m_frameSkip = frames;
+		break;
+	    }
+
+	    case 'l' :
+		m_loadStateFile = optarg;
+		break;
+
+	    case 'w' :
+		m_saveStateFile = optarg;
+		break;
+
+	    case 'b' :
+		m_rewindBudget = strtoul(optarg, nullptr, 10);
+		break;
+
+	    case 'i' :
+		m_rewindInterval = strtoul(optarg, nullptr, 10);
+
+		if (m_rewindInterval == 0)
+		    return false;
+
+		break;
+
+	    case 'a' :
+		m_runAhead = strtoul(optarg, nullptr, 10);
+
+		if (m_runAhead > 4)
+		    return false;
+
+		break;
+
+	    case 'm' :
+		m_recordMovieFile = optarg;
+		break;
+
+	    case 'p' :
+		m_playMovieFile = optarg;
+		break;
+
+	    case 't' :
+		m_traceFile = optarg;
+		break;
+
+	    case 'n' :
+		m_traceRecords = strtoul(optarg, nullptr, 10);
+
+		if (m_traceRecords == 0)
+		    return false;
+
+		break;
+
+	    case 'c' :
+	    {
+		// hexadecimal addresses, FIRST-LAST
+		char* end;
+		m_traceFirst = strtoul(optarg, &end, 16);
+
+		if (*end != '-')
+		    return false;
+
+		m_traceLast = strtoul(end + 1, nullptr, 16);
+		break;
+	    }
+
+	    case 'g' :
+		m_traceTrigger = strtoul(optarg, nullptr, 16) & 0xffff;
+		break;
+
+	    case 'v' :
+		m_videoFile = optarg;
+		break;
+
+	    default :
+		return false;
+	}
+    }
+
+    if (optind != argc - 1)
+	return false;
+
+    // the recorded input would be the played one
+    if (!m_recordMovieFile.empty() && !m_playMovieFile.empty())
+	return false;
+
+    // frames rendered by the render threads have no palette colours
+    if (!m_videoFile.empty() && m_renderThreads != 0)
+	return false;
+
+    m_cartridge = argv[optind];
+
+    return true;
+}
+
 // =====================================================================================================================
 bool NesEmulator::loadCartridge(const std::string& file)
 {
     Loader ldr;
 
-    if (!ldr.load(file))
+    try
+    {
+	ldr.load(file);
+    }
+    catch (const LoaderException& e)
+    {
+	std::cerr << e.what() << std::endl;
 	return false;
+    }
 
     const auto& rom = ldr.rom();
+    m_romCrc = ldr.crc32();
+
+    // keep stdout clean for the statistics in headless mode
+    if (!m_headless)
+    {
+	std::cout << "Program ROM size: " << rom->size() << " bytes" << std::endl;
+	std::cout << "ROM CRC-32: " << std::hex << std::setw(8) << std::setfill('0') << m_romCrc << std::dec
+		  << std::endl;
+    }
+
+    try
+    {
+	m_machine.reset(new Machine(ldr));
+    }
+    catch (const MapperException& e)
+    {
+	std::cerr << e.what() << std::endl;
+	return false;
+    }
+
+    return true;
+}
+
+// =====================================================================================================================
+void NesEmulator::runAheadFrame()
+{
+    // the real frame, its state is the one emulation continues from
+    m_machine->ppu().setVideoOutput(false);
+    m_machine->runFrame();
 
-    std::cout << "Program ROM size: " << rom->size() << " bytes" << std::endl;
+    m_machine->saveState(m_runAheadState);
 
-    // program ROM
-    m_memory.registerHandler(0x8000, rom->size(), rom);
+    // Emulate the following frames with the current input and present only the last of them. Their audio is not
+    // played, the real frames produce it when they are emulated.
+    m_machine->apu().setAudioOutput(false);
 
-    if (rom->size() < 32 * 1024)
-	m_memory.registerHandler(0xc000, rom->size(), rom);
+    for (unsigned i = 1; i < m_runAhead; ++i)
+	m_machine->runFrame();
 
-    // video ROM
-    m_ppu.reset(new PPU(ldr.vrom()));
+    m_machine->ppu().setVideoOutput(true);
+    m_machine->runFrame();
 
-    return true;
+    m_machine->apu().setAudioOutput(true);
+    m_machine->loadState(m_runAheadState);
+}
+
+// =====================================================================================================================
+bool NesEmulator::skipFrame()
+{
+    bool skip;
+
+    // the frames shown while rewinding are what the player steers by
+    if (m_rewinding)
+	skip = false;
+    else if (m_frameSkip != AUTO_FRAME_SKIP)
+	skip = m_skipped < unsigned(m_frameSkip);
+    else
+    {
+	// The display shows one frame per refresh, frames rendered faster than that while fast forwarding are never
+	// seen. The slack of a quarter refresh keeps the jitter of normal speed from skipping frames. A frame behind its
+	// deadline is caught up with by not rendering the next one, at least every MAX_AUTO_SKIP + 1th frame is rendered
+	// to keep the picture moving.
+	static const unsigned MAX_AUTO_SKIP = 8;
+	const uint64_t displayPeriod = uint64_t(1000000000 / FramePacer::FRAME_RATE);
+
+	if (FramePacer::now() - m_lastRendered < displayPeriod * 3 / 4)
+	    skip = true;
+	else
+	    skip = m_pacer.late() && m_skipped < MAX_AUTO_SKIP;
+    }
+
+    if (skip)
+	++m_skipped;
+    else
+    {
+	m_skipped = 0;
+	m_lastRendered = FramePacer::now();
+    }
+
+    return skip;
 }
 
 // =====================================================================================================================
 void NesEmulator::frameComplete()
 {
-    // give the gamepad a chance to handle user interaction
-    m_gamepad->pollEvents();
+    uint64_t now = FramePacer::now();
+
+    if (m_frameLimit != 0 && m_machine->ppu().frameCount() - m_firstFrame >= m_frameLimit)
+	m_running = false;
+
+    if (m_timeLimit > 0 && now - m_startTime >= m_timeLimit * 1000000000)
+	m_running = false;
+
+    // the converter repeats the frame before a skipped one
+    if (m_recorder && m_skipping)
+	m_recorder->skip();
+    else if (m_recorder)
+	m_recorder->submit(m_machine->ppu().indexFrame());
+
+    // headless runs are not interactive and not throttled
+    if (m_headless)
+	return;
+
+    // input is handled by the presenter thread
+    if (m_presenter->quitRequested())
+	m_running = false;
+
+    unsigned hotkeys = m_presenter->takeHotkeys();
+
+    if (hotkeys & Presenter::SAVE_STATE)
+	saveStateFile(m_cartridge + ".state");
+
+    if (hotkeys & Presenter::LOAD_STATE)
+	loadStateFile(m_cartridge + ".state");
+
+    m_rewinding = m_rewind && m_presenter->rewindRequested();
+
+    // states are captured while playing only, the frames shown while rewinding are already in the buffer
+    if (m_rewind && !m_rewinding && (m_machine->ppu().frameCount() - m_firstFrame) % m_rewindInterval == 0)
+    {
+	m_machine->saveState(m_stateBuffer);
+	m_rewind->push(m_stateBuffer);
+    }
+
+    // the video paces the emulation, the audio follows it by adjusting the sample rate of the next frame
+    if (m_audio)
+	m_machine->apu().setSampleRate(m_audio->sampleRate());
+
+    m_pacer.setTurbo(m_turbo || m_presenter->turboRequested());
+    NEMU_PROFILE_SCOPE(PACING);
+    m_pacer.wait();
+}
+
+// =====================================================================================================================
+bool NesEmulator::saveStateFile(const std::string& file)
+{
+    m_machine->saveState(m_stateBuffer);
 
-    // generate an NMI at the end of a PPU frame
-    m_cpu->nmi();
+    std::ofstream f(file.c_str(), std::ios::binary);
+    f.write(reinterpret_cast<const char*>(m_stateBuffer.data()), m_stateBuffer.size());
 
-    // calculate FPS
-    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    if (!f)
+    {
+	std::cerr << "Unable to write save state: " << file << std::endl;
+	return false;
+    }
 
-    if (!m_lastFrameEnd.is_not_a_date_time())
+    return true;
+}
+
+// =====================================================================================================================
+bool NesEmulator::loadStateFile(const std::string& file)
+{
+    std::ifstream f(file.c_str(), std::ios::binary);
+
+    if (!f)
     {
-	uint64_t frameTime = (now - m_lastFrameEnd).total_microseconds();
-	uint64_t desiredFrameTime = 1000000 / 45;
+	std::cerr << "Unable to open save state: " << file << std::endl;
+	return false;
+    }
 
-	//double fps = 1000000.0f / frameTime;
-	//std::cout << "FPS: " << fps << "          \r";
+    m_stateBuffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
 
-	if (frameTime <= desiredFrameTime)
+    // a state failing half way leaves the machine inconsistent, the previous state is restored in that case
+    std::vector<uint8_t> previous;
+    m_machine->saveState(previous);
+
+    try
+    {
+	m_machine->loadState(m_stateBuffer);
+    }
+    catch (const StateException& e)
+    {
+	std::cerr << "Unable to load save state " << file << ": " << e.what() << std::endl;
+	m_machine->loadState(previous);
+	return false;
+    }
+
+    return true;
+}
+
+// =====================================================================================================================
+bool NesEmulator::startMovie()
+{
+    if (!m_recordMovieFile.empty())
+	m_movie.reset(new Movie(m_romCrc, m_machine->ppu().frameCount()));
+    else if (!m_playMovieFile.empty())
+    {
+	std::ifstream f(m_playMovieFile.c_str(), std::ios::binary);
+
+	if (!f)
 	{
-	    timespec t = {0, (desiredFrameTime - frameTime) * 1000};
-	    nanosleep(&t, NULL);
+	    std::cerr << "Unable to open movie: " << m_playMovieFile << std::endl;
+	    return false;
+	}
+
+	std::vector<uint8_t> buffer((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+	m_movie.reset(new Movie());
+
+	try
+	{
+	    m_movie->load(buffer);
+	}
+	catch (const StateException& e)
+	{
+	    std::cerr << "Unable to load movie " << m_playMovieFile << ": " << e.what() << std::endl;
+	    return false;
+	}
+
+	if (m_movie->romCrc() != m_romCrc)
+	{
+	    std::cerr << "Movie " << m_playMovieFile << " was recorded on a different ROM" << std::endl;
+	    return false;
+	}
+
+	// the movie only reproduces the run from the state it was recorded from
+	if (m_movie->startFrame() != m_machine->ppu().frameCount())
+	{
+	    std::cerr << "Movie " << m_playMovieFile << " starts at frame " << m_movie->startFrame()
+		      << ", the machine is at frame " << m_machine->ppu().frameCount() << std::endl;
+	    return false;
+	}
+
+	// nobody looks at the frames of a headless replay unless they are recorded, only the status flags the game sees
+	// are evaluated
+	if (m_headless && !m_recorder)
+	{
+	    m_machine->ppu().setVideoOutput(false);
+	    // every frame is skipped already
+	    m_frameSkip = 0;
 	}
     }
+    else
+	return true;
+
+    m_machine->gamepad()->setInputCallback([this]() { return m_movieInput; });
+
+    return true;
+}
+
+// =====================================================================================================================
+void NesEmulator::updateMovieInput()
+{
+    unsigned frame = m_machine->ppu().frameCount();
 
-    m_lastFrameEnd = now;
+    if (m_playMovieFile.empty())
+    {
+	// the input is sampled once per frame so the recording sees exactly what the game saw
+	m_movieInput = m_machine->gamepad()->buttons();
+	m_movie->record(frame, m_movieInput);
+	return;
+    }
+
+    if (m_movie->input(frame, m_movieInput))
+	return;
+
+    if (m_headless)
+	m_running = false;
+    else
+    {
+	m_machine->gamepad()->setInputCallback(nullptr);
+	m_movie.reset();
+    }
+}
+
+// =====================================================================================================================
+bool NesEmulator::saveMovieFile(const std::string& file)
+{
+    std::vector<uint8_t> buffer;
+    m_movie->save(buffer);
+
+    std::ofstream f(file.c_str(), std::ios::binary);
+    f.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+
+    if (!f)
+    {
+	std::cerr << "Unable to write movie: " << file << std::endl;
+	return false;
+    }
+
+    return true;
+}
+
+// =====================================================================================================================
+void NesEmulator::printStatistics()
+{
+    double wallTime = (FramePacer::now() - m_startTime) / 1000000000.0;
+    double frames = m_machine->ppu().frameCount() - m_firstFrame;
+
+    if (wallTime <= 0)
+	wallTime = 1e-6;
+
+    std::cout << std::fixed << std::setprecision(6)
+	      << "{\"frames\": " << m_machine->ppu().frameCount() - m_firstFrame
+	      << ", \"cpu_cycles\": " << m_machine->cycles()
+	      << ", \"ppu_dots\": " << m_machine->cycles() * 3
+	      << ", \"wall_time_s\": " << wallTime
+	      << ", \"frames_per_s\": " << frames / wallTime
+	      << ", \"cpu_cycles_per_s\": " << m_machine->cycles() / wallTime
+	      << ", \"ppu_dots_per_s\": " << m_machine->cycles() * 3 / wallTime
+	      << "}" << std::endl;
 }
@@ -1,4 +1,5 @@
 #include <nemu/ppu.h>
+#include <nemu/profiler.h>
 
 #include <lib6502/makestring.h>
 
@@ -10,17 +11,10 @@
 
 using lib6502::MakeString;
 
-uint32_t PPU::s_rgbPalette[64] = {
-    // 1                                                                  8
-    0x747474, 0x24188c, 0x0000a8, 0x44009c, 0x8c0074, 0xa80010, 0xa40000, 0x7c0800, 0x402c00, 0x004400, 0x005000, 0x003c14, 0x183c5c, 0x000000, 0x000000, 0x000000,
-    0xbcbcbc, 0x0070ec, 0x2038ec, 0x8000f0, 0xbc00bc, 0xe40058, 0xd82800, 0xc84c0c, 0x887000, 0x009400, 0x00a800, 0x009038, 0x008088, 0x000000, 0x000000, 0x000000,
-    0xf8f8f8, 0x3cbcfc, 0x5c94fc, 0x4088fc, 0xf478fc, 0xfc74b4, 0xfc7460, 0xfc9838, 0xf0bc3c, 0x80d010, 0x4cdc48, 0x58f898, 0x00e8d8, 0x787878, 0x000000, 0x000000,
-    0xffffff, 0xa8e4fc, 0xc4d4fc, 0xd4c8fc, 0xfcc4fc, 0xfcc4d8, 0xfcbcb0, 0xfcd8a8, 0xfce4a0, 0xe0fca0, 0xa8f0bc, 0xb0fccc, 0x9cfcf0, 0xc4c4c4, 0x000000, 0x000000
-};
-
 // =====================================================================================================================
 PPU::PPU(const std::shared_ptr<memory::ROM>& vrom)
-    : m_ctrl(0),
+    : m_vrom(vrom),
+      m_ctrl(0),
       m_mask(0),
       m_status(0),
       m_address(0),
@@ -29,26 +23,57 @@ PPU::PPU(const std::shared_ptr<memory::ROM>& vrom)
       m_scrollX(0),
       m_scrollY(0),
       m_tickCounter(0),
-      m_currentScanLine(0)
+      m_currentScanLine(0),
+      m_frameCount(0),
+      m_videoOutput(true),
+      m_fourScreen(false),
+      m_currentFrame(0),
+      m_framePending(false)
 {
-    // register video ROM
-    m_memory.registerHandler(0, vrom->size(), vrom);
+    memset(&m_state, 0, sizeof(m_state));
 
-    // register name table RAM regions
-    for (unsigned i = 0; i < 4; ++i)
+    // register video ROM, cartridges without one have 8kB of pattern RAM instead
+    if (m_vrom->size() == 0)
     {
-	m_nameTables[i] = std::make_shared<memory::RAM>(0x400);
-	m_memory.registerHandler(0x2000 + i * 0x400, 0x400, m_nameTables[i]);
+	m_patternRam = std::make_shared<memory::RAM>(0x2000);
+	memset(m_patternRam->data(), 0, m_patternRam->size());
+	m_memory.registerHandler(0, m_patternRam->size(), m_patternRam);
     }
+    else
+	m_memory.registerHandler(0, std::min(m_vrom->size(), 0x2000u), m_vrom);
+
+    // the first 8kB are mapped until the mapper switches banks
+    for (unsigned i = 0; i < 8; ++i)
+	setPatternBank(i, i);
+
+    // the name table slots are mapped into CIRAM, horizontal mirroring until the cartridge selects its arrangement
+    m_ciram = std::make_shared<memory::RAM>(0x1000);
+
+    for (unsigned i = 0; i < 4; ++i)
+	m_nameTableBanks[i] = ~0u;
+
+    setMirroring(MIRROR_HORIZONTAL);
 
     // register palette memory
     m_palette = std::make_shared<PaletteMemory>();
     m_memory.registerHandler(0x3f00, 0x20, m_palette);
+    m_state.m_palette = m_palette->data();
 
     // create sprite memory
-    m_sprite.reset(new memory::RAM(64 * 4));
+    m_sprite = std::make_shared<SpriteMemory>();
+    m_state.m_oam = m_sprite->data();
+
+    m_renderer.rebuildTiles(m_state);
 
-    m_screen = SDL_SetVideoMode(256, 240, 32, SDL_SWSURFACE);
+    memset(m_frameBuffer, 0, sizeof(m_frameBuffer));
+}
+
+// =====================================================================================================================
+PPU::~PPU()
+{
+    // the workers may still be rendering into the buffers of the PPU
+    m_frameRenderer.reset();
+    m_sprite->setWriteCallback(nullptr);
 }
 
 // =====================================================================================================================
@@ -57,6 +82,147 @@ void PPU::setNmiCallback(const std::function<void ()>& nmiCallback)
     m_nmiCallback = nmiCallback;
 }
 
+// =====================================================================================================================
+void PPU::setFrameCallback(const std::function<void(const uint32_t*)>& frameCallback)
+{
+    m_frameCallback = frameCallback;
+}
+
+// =====================================================================================================================
+void PPU::setRenderThreads(unsigned threads)
+{
+    if (m_frameRenderer)
+    {
+	m_frameRenderer->wait();
+	m_frameRenderer.reset();
+	m_sprite->setWriteCallback(nullptr);
+    }
+
+    m_framePending = false;
+
+    if (threads == 0)
+	return;
+
+    m_frameRenderer.reset(new FrameRenderer(threads));
+
+    if (!m_deferredFrames)
+	m_deferredFrames.reset(new uint32_t[2 * 256 * 240]());
+
+    // the log of the current frame starts with the state the PPU is in now
+    m_currentFrame = 0;
+    beginFrameLog();
+
+    m_sprite->setWriteCallback([this](uint16_t address, uint8_t data) {
+	logWrite(RenderLogEntry::OAM, address, data);
+    });
+}
+
+// =====================================================================================================================
+void PPU::setIndexOutput(bool enabled)
+{
+    if (enabled && !m_indexFrame)
+	m_indexFrame.reset(new uint8_t[256 * 240]());
+    else if (!enabled)
+	m_indexFrame.reset();
+}
+
+// =====================================================================================================================
+const uint32_t* PPU::frameBuffer() const
+{
+    return m_frameBuffer;
+}
+
+// =====================================================================================================================
+const uint8_t* PPU::indexFrame() const
+{
+    return m_indexFrame.get();
+}
+
+// =====================================================================================================================
+void PPU::setScanlineCallback(const std::function<void()>& scanlineCallback)
+{
+    m_scanlineCallback = scanlineCallback;
+}
+
+// =====================================================================================================================
+void PPU::setPatternBank(unsigned window, unsigned bank)
+{
+    unsigned offset = bank * TileCache::WINDOW_SIZE;
+    uint16_t address = window * TileCache::WINDOW_SIZE;
+
+    if (m_patternRam)
+    {
+	uint8_t* data = m_patternRam->data() + offset % m_patternRam->size();
+
+	m_memory.mapPages(address, TileCache::WINDOW_SIZE, data, data);
+	m_state.m_patterns[window] = data;
+    }
+    else
+    {
+	const uint8_t* data = m_vrom->data() + offset % m_vrom->size();
+
+	// writes go to the ROM handler which rejects them
+	m_memory.mapPages(address, TileCache::WINDOW_SIZE, data, nullptr);
+	m_state.m_patterns[window] = data;
+    }
+
+    logWrite(RenderLogEntry::PATTERN_BANK, window, bank);
+}
+
+// =====================================================================================================================
+void PPU::setVideoOutput(bool enabled)
+{
+    if (m_videoOutput == enabled)
+	return;
+
+    m_videoOutput = enabled;
+
+    // nothing was logged while the output was disabled, the log starts over with the current state
+    if (m_videoOutput && m_frameRenderer)
+	beginFrameLog();
+}
+
+// =====================================================================================================================
+void PPU::setMirroring(Mirroring mirroring)
+{
+    static const unsigned s_banks[5][4] = {
+	{0, 0, 1, 1},
+	{0, 1, 0, 1},
+	{0, 0, 0, 0},
+	{1, 1, 1, 1},
+	{0, 1, 2, 3}
+    };
+
+    if (m_fourScreen)
+	return;
+
+    m_fourScreen = mirroring == MIRROR_FOUR_SCREEN;
+
+    for (unsigned i = 0; i < 4; ++i)
+	setNameTableBank(i, s_banks[mirroring][i]);
+}
+
+// =====================================================================================================================
+void PPU::setNameTableBank(unsigned slot, unsigned bank)
+{
+    bank %= 4;
+
+    // mappers select the mirroring again with every bank switch
+    if (m_nameTableBanks[slot] == bank)
+	return;
+
+    uint8_t* data = m_ciram->data() + bank * 0x400;
+
+    // $3000-$3eff mirrors the slots, the last 256 bytes of slot 3 are covered by the palette
+    m_memory.mapPages(0x2000 + slot * 0x400, 0x400, data, data);
+    m_memory.mapPages(0x3000 + slot * 0x400, slot == 3 ? 0x300 : 0x400, data, data);
+
+    m_nameTableBanks[slot] = bank;
+    m_state.m_nameTables[slot] = data;
+
+    logWrite(RenderLogEntry::NAME_TABLE_BANK, slot, bank);
+}
+
 // =====================================================================================================================
 void PPU::tick()
 {
@@ -64,8 +230,18 @@ void PPU::tick()
 
     if (m_tickCounter == 341)
     {
-	renderScanLine(m_currentScanLine);
-	renderSpriteLine(m_currentScanLine);
+	// the scanline counter of the cartridge is clocked on visible lines while rendering is enabled
+	if (m_scanlineCallback && m_currentScanLine >= 20 && (m_mask & 0x18))
+	    m_scanlineCallback();
+
+	if (m_frameRenderer || !m_videoOutput)
+	    evaluateScanLine(m_currentScanLine);
+	else
+	{
+	    renderScanLine(m_currentScanLine);
+	    renderSpriteLine(m_currentScanLine);
+	    outputScanLine(m_currentScanLine);
+	}
 
 	++m_currentScanLine;
 	m_tickCounter = 0;
@@ -75,7 +251,7 @@ void PPU::tick()
 	    finishRendering();
 
 	    m_status |= VBLANK;
-	    m_status &= ~SPRITE0_HIT;
+	    m_status &= ~(SPRITE0_HIT | SPRITE_OVERFLOW);
 
 	    m_currentScanLine = 0;
 
@@ -88,11 +264,17 @@ void PPU::tick()
 }
 
 // =====================================================================================================================
-const std::shared_ptr<memory::RAM>& PPU::spriteRam() const
+const std::shared_ptr<SpriteMemory>& PPU::spriteRam() const
 {
     return m_sprite;
 }
 
+// =====================================================================================================================
+unsigned PPU::frameCount() const
+{
+    return m_frameCount;
+}
+
 // =====================================================================================================================
 uint8_t PPU::read(uint16_t address)
 {
@@ -122,10 +304,12 @@ void PPU::write(uint16_t address, uint8_t data)
 	    // TODO: for now only 8x8 sprites are supported
 	    assert((m_ctrl & 0x20) == 0);
 
+	    logWrite(RenderLogEntry::CTRL, 0, data);
 	    break;
 
 	case PPUMASK :
 	    m_mask = data;
+	    logWrite(RenderLogEntry::MASK, 0, data);
 	    break;
 
 	case OAMADDR :
@@ -152,16 +336,92 @@ void PPU::write(uint16_t address, uint8_t data)
 }
 
 // =====================================================================================================================
-uint8_t PPU::readStatusRegister()
+void PPU::saveState(StateWriter& writer) const
 {
-    static unsigned accessCounter = 0;
-    ++accessCounter;
+    writer.beginSection("PPU ");
+
+    writer.write(m_ctrl);
+    writer.write(m_mask);
+    writer.write(m_status);
+    writer.write(m_address);
+    writer.write(m_firstAddrWrite);
+    writer.write(m_dataLatch);
+    writer.write(m_scrollX);
+    writer.write(m_scrollY);
+    writer.write(m_tickCounter);
+    writer.write(m_currentScanLine);
+    writer.write(m_frameCount);
+
+    m_ciram->saveState(writer);
+    writer.write(m_nameTableBanks);
+
+    m_palette->saveState(writer);
+    m_sprite->saveState(writer);
+
+    writer.write<bool>(m_patternRam != nullptr);
+
+    if (m_patternRam)
+	m_patternRam->saveState(writer);
+}
+
+// =====================================================================================================================
+void PPU::loadState(StateReader& reader)
+{
+    reader.beginSection("PPU ");
+
+    m_ctrl = reader.read<uint8_t>();
+    m_mask = reader.read<uint8_t>();
+    m_status = reader.read<uint8_t>();
+    m_address = reader.read<uint16_t>();
+    m_firstAddrWrite = reader.read<bool>();
+    m_dataLatch = reader.read<uint8_t>();
+    m_scrollX = reader.read<uint8_t>();
+    m_scrollY = reader.read<uint8_t>();
+    m_tickCounter = reader.read<unsigned>();
+    m_currentScanLine = reader.read<unsigned>();
+    m_frameCount = reader.read<unsigned>();
+
+    m_ciram->loadState(reader);
+
+    for (unsigned i = 0; i < 4; ++i)
+	setNameTableBank(i, reader.read<unsigned>());
+
+    m_palette->loadState(reader);
+    m_sprite->loadState(reader);
+
+    if (reader.read<bool>() != (m_patternRam != nullptr))
+	throw StateException("pattern memory mismatch");
 
+    if (m_patternRam)
+    {
+	m_patternRam->loadState(reader);
+	m_renderer.invalidatePatterns();
+    }
+
+    m_sprite->markChanged();
+    m_renderer.invalidatePalette();
+
+    // the frame rendered by the workers was completed before the state was loaded, it is presented right away
+    if (m_frameRenderer)
+    {
+	m_frameRenderer->wait();
+
+	if (m_framePending && m_frameCallback)
+	    m_frameCallback(m_deferredFrames.get() + (m_currentFrame ^ 1) * 256 * 240);
+
+	m_framePending = false;
+	beginFrameLog();
+    }
+}
+
+// =====================================================================================================================
+uint8_t PPU::readStatusRegister()
+{
     // reset the state of the address latch
     m_firstAddrWrite = true;
 
-    // return the current value of the status register
-    uint8_t status = m_status | (accessCounter % 2 == 0 ? 0x40 : 0);
+    // the sprite 0 hit and overflow flags are set by the rendering of the lines
+    uint8_t status = m_status;
 
     // clear vblank flag
     m_status &= ~VBLANK;
@@ -199,6 +459,13 @@ void PPU::writeAddressRegister(uint8_t data)
 void PPU::writeDataRegister(uint8_t data)
 {
     m_memory.write(m_address, data);
+    logWrite(RenderLogEntry::VRAM, m_address, data);
+
+    // keep the decoded tiles and the resolved colours in sync
+    if (m_address < 0x2000)
+	m_renderer.invalidatePattern(m_state, m_state.m_patterns[m_address / 0x400] + m_address % 0x400);
+    else if (m_address >= 0x3f00)
+	m_renderer.invalidatePalette();
 
     incrementAddress();
 }
@@ -207,9 +474,15 @@ void PPU::writeDataRegister(uint8_t data)
 void PPU::writeScrollRegister(uint8_t data)
 {
     if (m_firstAddrWrite)
+    {
 	m_scrollX = data;
+	logWrite(RenderLogEntry::SCROLL_X, 0, data);
+    }
     else
+    {
 	m_scrollY = data;
+	logWrite(RenderLogEntry::SCROLL_Y, 0, data);
+    }
 
     m_firstAddrWrite = !m_firstAddrWrite;
 }
@@ -224,126 +497,127 @@ void PPU::incrementAddress()
 }
 
 // =====================================================================================================================
-void PPU::renderScanLine(unsigned _line)
+void PPU::syncRenderState()
 {
-    if (_line < 20)
-	return;
-
-    unsigned line = _line - 20;
+    m_state.m_ctrl = m_ctrl;
+    m_state.m_mask = m_mask;
+    m_state.m_scrollX = m_scrollX;
+    m_state.m_scrollY = m_scrollY;
 
-    unsigned* data = m_scanLineData;
-
-    for (unsigned c = 0; c < 256; ++c)
+    if (m_sprite->changed())
     {
-	unsigned col = c + m_scrollX;
-
-	unsigned nameTableIdx = (col / 256) % 2;
-	unsigned pixelIdx = col % 256;
-	unsigned tileIdx = (line / 8) * 32 + pixelIdx / 8;
+	m_renderer.invalidateSprites();
+	m_sprite->clearChanged();
+    }
+}
 
-	unsigned attrByteIdx = (line / 32) * 8 + (pixelIdx / 32);
-	unsigned attrRow = (line / 16) % 2;
-	unsigned attrCol = (pixelIdx / 16) % 2;
-	unsigned attrShift = (attrRow * 2 + attrCol) * 2 /* 2 bit per block */;
+// =====================================================================================================================
+void PPU::logWrite(RenderLogEntry::Type type, uint16_t address, uint8_t data)
+{
+    if (!m_frameRenderer || !m_videoOutput)
+	return;
 
-	unsigned nameTable = ((m_ctrl & 0x3) + nameTableIdx) % 2;
-	uint8_t nameTableEntry = m_nameTables[nameTable]->read(tileIdx);
-	uint8_t attrData = (m_nameTables[nameTable]->read(30 * 32 /* tiles */ + attrByteIdx) >> attrShift) & 0x3;
+    RenderLogEntry entry;
+    entry.m_dot = m_currentScanLine * 341 + m_tickCounter;
+    entry.m_address = address;
+    entry.m_type = type;
+    entry.m_data = data;
 
-	uint16_t patternTable = 0x1000;
-	uint8_t layer1 = m_memory.read(patternTable + (nameTableEntry << 4) + line % 8);
-	uint8_t layer2 = m_memory.read(patternTable + (nameTableEntry << 4) + 8 + (line % 8));
+    m_renderLogs[m_currentFrame].push_back(entry);
+}
 
-	unsigned tileCol = pixelIdx % 8;
-	uint8_t pixelData = (((layer2 >> (7 - tileCol)) & 1) << 1) | ((layer1 >> (7 - tileCol)) & 1);
+// =====================================================================================================================
+void PPU::evaluateScanLine(unsigned line)
+{
+    if (line < 20)
+	return;
 
-	if (pixelData != 0)
-	    *data = pixelData | (attrData << 2);
-	else
-	    *data = 0;
+    syncRenderState();
+    m_status |= m_renderer.evaluateStatus(m_state, line - 20);
+}
 
-	++data;
-    }
+// =====================================================================================================================
+void PPU::renderScanLine(unsigned line)
+{
+    if (line < 20)
+	return;
 
-    data = m_scanLineData;
-    uint32_t* pixel = (uint32_t*)((uint8_t*)m_screen->pixels + line * m_screen->pitch);
+    NEMU_PROFILE_SCOPE(RENDER_BACKGROUND);
 
-    for (unsigned c = 0; c < 256; ++c)
-	*pixel++ = s_rgbPalette[m_palette->read(*data++ & 0x3f)];
+    syncRenderState();
+    m_renderer.renderBackground(m_state, line - 20);
 }
 
 // =====================================================================================================================
-void PPU::renderSpriteLine(unsigned _line)
+void PPU::renderSpriteLine(unsigned line)
 {
-    if (_line < 20)
+    if (line < 20)
 	return;
 
-    unsigned line = _line - 20;
+    NEMU_PROFILE_SCOPE(RENDER_SPRITES);
 
-    for (unsigned i = 0; i < 64; ++i)
-    {
-	uint8_t y = m_sprite->read(i * 4 + 0);
+    syncRenderState();
+    m_status |= m_renderer.renderSprites(m_state, line - 20);
+}
 
-	// skip this one if it is not visible in this line
-	if (line < y || line >= (y + 8u))
-	    continue;
+// =====================================================================================================================
+void PPU::outputScanLine(unsigned line)
+{
+    if (line < 20)
+	return;
 
-	uint8_t x = m_sprite->read(i * 4 + 3);
+    NEMU_PROFILE_SCOPE(OUTPUT_LINE);
 
-	unsigned visX = 256 - x;
+    m_renderer.output(m_state, m_frameBuffer + (line - 20) * 256);
 
-	uint8_t idx = m_sprite->read(i * 4 + 1);
-	uint8_t attr = m_sprite->read(i * 4 + 2);
-	bool flipHoriz = attr & 0x40;
-	bool flipVert = attr & 0x80;
+    if (m_indexFrame)
+	m_renderer.outputIndices(m_state, m_indexFrame.get() + (line - 20) * 256);
+}
 
-	uint16_t patternTable = (m_ctrl & 0x8) ? 0x1000 : 0x000;
+// =====================================================================================================================
+void PPU::finishRendering()
+{
+    NEMU_PROFILE_SCOPE(FINISH_FRAME);
 
-	// find out which row of the sprite we are rendering actually
-	unsigned row = line - y;
+    ++m_frameCount;
 
-	uint8_t layer1;
-	uint8_t layer2;
+    if (!m_videoOutput)
+	return;
 
-	if (flipVert)
-	{
-	    layer1 = m_memory.read(patternTable + idx * 16 + (7 - row));
-	    layer2 = m_memory.read(patternTable + idx * 16 + 8 + (7 - row));
-	}
-	else
-	{
-	    layer1 = m_memory.read(patternTable + idx * 16 + row);
-	    layer2 = m_memory.read(patternTable + idx * 16 + 8 + row);
-	}
+    if (m_frameRenderer)
+    {
+	finishDeferredFrame();
+	return;
+    }
 
-	uint32_t* pixel = (uint32_t*)((uint8_t*)m_screen->pixels + line * m_screen->pitch + (x * 4));
+    if (m_frameCallback)
+	m_frameCallback(m_frameBuffer);
+}
 
-	for (unsigned col = 0; col < std::min(visX, 8u); ++col)
-	{
-	    uint8_t pixelData;
+// =====================================================================================================================
+void PPU::finishDeferredFrame()
+{
+    unsigned previous = m_currentFrame ^ 1;
 
-	    if (flipHoriz)
-		pixelData = (((layer2 >> col) & 1) << 1) | ((layer1 >> col) & 1);
-	    else
-		pixelData = (((layer2 >> (7 - col)) & 1) << 1) | ((layer1 >> (7 - col)) & 1);
+    // render() waits for the previous frame so its buffer is complete afterwards
+    m_frameRenderer->render(m_frameStarts[m_currentFrame], m_renderLogs[m_currentFrame],
+			    m_deferredFrames.get() + m_currentFrame * 256 * 240);
 
-	    if (pixelData != 0)
-	    {
-		//if (i == 0 && m_scanLineData[x + col] != 0)
-		//    m_status |= SPRITE0_HIT;
+    if (m_framePending && m_frameCallback)
+	m_frameCallback(m_deferredFrames.get() + previous * 256 * 240);
 
-		uint8_t attrData = attr & 0x3;
-		uint8_t paletteData = m_palette->read(0x10 | (attrData << 2) | pixelData);
-		*pixel = s_rgbPalette[paletteData];
-	    }
+    m_framePending = true;
 
-	    ++pixel;
-	}
-    }
+    // the buffers of the previous frame are free for the next one
+    m_currentFrame = previous;
+    beginFrameLog();
 }
 
 // =====================================================================================================================
-void PPU::finishRendering()
+void PPU::beginFrameLog()
 {
-    SDL_Flip(m_screen);
+    syncRenderState();
+    m_frameStarts[m_currentFrame].capture(m_state, m_ciram->data(), m_patternRam ? m_patternRam->data() : nullptr,
+					  m_patternRam ? m_patternRam->size() : 0, m_vrom->data(), m_vrom->size());
+    m_renderLogs[m_currentFrame].clear();
 }
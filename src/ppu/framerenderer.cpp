@@ -0,0 +1,328 @@
+#include <nemu/ppu/framerenderer.h>
+#include <nemu/ppu/palette.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+// =====================================================================================================================
+RenderSnapshot::RenderSnapshot()
+{
+    memset(m_ciram, 0, sizeof(m_ciram));
+    memset(m_palette, 0, sizeof(m_palette));
+    memset(m_oam, 0, sizeof(m_oam));
+    memset(m_patternRam, 0, sizeof(m_patternRam));
+    m_patternRamSize = 0;
+    m_patternRom = nullptr;
+    m_patternRomSize = 0;
+
+    for (unsigned i = 0; i < 4; ++i)
+	m_nameTableBanks[i] = i;
+
+    for (unsigned i = 0; i < 8; ++i)
+    {
+	m_ramPatterns[i] = false;
+	m_ramPatternOffsets[i] = 0;
+	m_romPatterns[i] = nullptr;
+    }
+
+    m_state.m_ctrl = 0;
+    m_state.m_mask = 0;
+    m_state.m_scrollX = 0;
+    m_state.m_scrollY = 0;
+
+    updateState();
+}
+
+// =====================================================================================================================
+void RenderSnapshot::capture(const RenderState& live, const uint8_t* ciram, const uint8_t* patternRam,
+			     unsigned patternRamSize, const uint8_t* patternRom, unsigned patternRomSize)
+{
+    m_patternRamSize = patternRam ? std::min<unsigned>(patternRamSize, sizeof(m_patternRam)) : 0;
+    m_patternRom = patternRom;
+    m_patternRomSize = patternRomSize;
+
+    m_state.m_ctrl = live.m_ctrl;
+    m_state.m_mask = live.m_mask;
+    m_state.m_scrollX = live.m_scrollX;
+    m_state.m_scrollY = live.m_scrollY;
+
+    // the whole CIRAM is copied, slots may be pointed at any page of it during the frame
+    memcpy(m_ciram, ciram, sizeof(m_ciram));
+
+    for (unsigned i = 0; i < 4; ++i)
+	m_nameTableBanks[i] = (live.m_nameTables[i] - ciram) / 0x400;
+
+    memcpy(m_palette, live.m_palette, sizeof(m_palette));
+    memcpy(m_oam, live.m_oam, sizeof(m_oam));
+
+    if (patternRam)
+	memcpy(m_patternRam, patternRam, m_patternRamSize);
+
+    for (unsigned i = 0; i < 8; ++i)
+    {
+	const uint8_t* window = live.m_patterns[i];
+
+	m_ramPatterns[i] = patternRam && window >= patternRam && window < patternRam + patternRamSize;
+
+	if (m_ramPatterns[i])
+	    m_ramPatternOffsets[i] = window - patternRam;
+	else
+	    m_romPatterns[i] = window;
+    }
+
+    updateState();
+}
+
+// =====================================================================================================================
+void RenderSnapshot::copyFrom(const RenderSnapshot& other)
+{
+    m_state = other.m_state;
+
+    memcpy(m_ciram, other.m_ciram, sizeof(m_ciram));
+    memcpy(m_nameTableBanks, other.m_nameTableBanks, sizeof(m_nameTableBanks));
+    memcpy(m_palette, other.m_palette, sizeof(m_palette));
+    memcpy(m_oam, other.m_oam, sizeof(m_oam));
+    memcpy(m_ramPatterns, other.m_ramPatterns, sizeof(m_ramPatterns));
+    memcpy(m_ramPatternOffsets, other.m_ramPatternOffsets, sizeof(m_ramPatternOffsets));
+    memcpy(m_romPatterns, other.m_romPatterns, sizeof(m_romPatterns));
+    m_patternRamSize = other.m_patternRamSize;
+    m_patternRom = other.m_patternRom;
+    m_patternRomSize = other.m_patternRomSize;
+
+    if (other.hasPatternRam())
+	memcpy(m_patternRam, other.m_patternRam, sizeof(m_patternRam));
+
+    updateState();
+}
+
+// =====================================================================================================================
+void RenderSnapshot::apply(const RenderLogEntry& entry, Renderer& renderer)
+{
+    switch (entry.m_type)
+    {
+	case RenderLogEntry::CTRL : m_state.m_ctrl = entry.m_data; break;
+	case RenderLogEntry::MASK : m_state.m_mask = entry.m_data; break;
+	case RenderLogEntry::SCROLL_X : m_state.m_scrollX = entry.m_data; break;
+	case RenderLogEntry::SCROLL_Y : m_state.m_scrollY = entry.m_data; break;
+
+	case RenderLogEntry::OAM :
+	    m_oam[entry.m_address & 0xff] = entry.m_data;
+	    renderer.invalidateSprites();
+	    break;
+
+	case RenderLogEntry::PATTERN_BANK :
+	{
+	    // the same selection of the pattern memory as PPU::setPatternBank()
+	    unsigned window = entry.m_address % 8;
+	    unsigned offset = entry.m_data * 0x400;
+
+	    if (m_patternRomSize != 0)
+	    {
+		m_ramPatterns[window] = false;
+		m_romPatterns[window] = m_patternRom + offset % m_patternRomSize;
+	    }
+	    else if (m_patternRamSize != 0)
+	    {
+		m_ramPatterns[window] = true;
+		m_ramPatternOffsets[window] = offset % m_patternRamSize;
+	    }
+
+	    updateState();
+	    break;
+	}
+
+	case RenderLogEntry::NAME_TABLE_BANK :
+	    m_nameTableBanks[entry.m_address % 4] = entry.m_data % 4;
+	    updateState();
+	    break;
+
+	case RenderLogEntry::VRAM :
+	{
+	    uint16_t address = entry.m_address;
+
+	    if (address < 0x2000)
+	    {
+		// only writable pattern memory gets logged
+		unsigned window = address / 0x400;
+
+		if (m_ramPatterns[window])
+		{
+		    uint8_t* data = m_patternRam + m_ramPatternOffsets[window] + address % 0x400;
+
+		    *data = entry.m_data;
+		    renderer.invalidatePattern(m_state, data);
+		}
+	    }
+	    else if (address < 0x3f00)
+		m_ciram[m_nameTableBanks[(address - 0x2000) / 0x400 % 4]][address % 0x400] = entry.m_data;
+	    else if (address >= 0x3f00)
+	    {
+		m_palette[PaletteMemory::translateAddress(address & 0x1f)] = entry.m_data;
+		renderer.invalidatePalette();
+	    }
+
+	    break;
+	}
+    }
+}
+
+// =====================================================================================================================
+bool RenderSnapshot::hasPatternRam() const
+{
+    for (unsigned i = 0; i < 8; ++i)
+    {
+	if (m_ramPatterns[i])
+	    return true;
+    }
+
+    return false;
+}
+
+// =====================================================================================================================
+const RenderState& RenderSnapshot::state() const
+{
+    return m_state;
+}
+
+// =====================================================================================================================
+void RenderSnapshot::updateState()
+{
+    for (unsigned i = 0; i < 4; ++i)
+	m_state.m_nameTables[i] = m_ciram[m_nameTableBanks[i]];
+
+    for (unsigned i = 0; i < 8; ++i)
+	m_state.m_patterns[i] = m_ramPatterns[i] ? m_patternRam + m_ramPatternOffsets[i] : m_romPatterns[i];
+
+    m_state.m_palette = m_palette;
+    m_state.m_oam = m_oam;
+}
+
+// =====================================================================================================================
+FrameRenderer::FrameRenderer(unsigned threads)
+    : m_generation(0),
+      m_pending(0),
+      m_stop(false),
+      m_frameStart(nullptr),
+      m_log(nullptr),
+      m_output(nullptr)
+{
+    if (threads == 0)
+	threads = 1;
+
+    // split the 240 visible lines evenly
+    for (unsigned i = 0; i < threads; ++i)
+    {
+	std::unique_ptr<Worker> worker(new Worker());
+	worker->m_firstLine = 240 * i / threads;
+	worker->m_lastLine = 240 * (i + 1) / threads;
+	m_workers.push_back(std::move(worker));
+    }
+
+    for (auto& worker : m_workers)
+	worker->m_thread = std::thread(&FrameRenderer::work, this, std::ref(*worker));
+}
+
+// =====================================================================================================================
+FrameRenderer::~FrameRenderer()
+{
+    {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_stop = true;
+    }
+
+    m_startCond.notify_all();
+
+    for (auto& worker : m_workers)
+	worker->m_thread.join();
+}
+
+// =====================================================================================================================
+void FrameRenderer::render(const RenderSnapshot& frameStart, const std::vector<RenderLogEntry>& log, uint32_t* output)
+{
+    wait();
+
+    {
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	m_frameStart = &frameStart;
+	m_log = &log;
+	m_output = output;
+
+	m_pending = m_workers.size();
+	++m_generation;
+    }
+
+    m_startCond.notify_all();
+}
+
+// =====================================================================================================================
+void FrameRenderer::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (m_pending != 0)
+	m_doneCond.wait(lock);
+}
+
+// =====================================================================================================================
+void FrameRenderer::work(Worker& worker)
+{
+    unsigned generation = 0;
+
+    while (true)
+    {
+	{
+	    std::unique_lock<std::mutex> lock(m_mutex);
+
+	    while (!m_stop && m_generation == generation)
+		m_startCond.wait(lock);
+
+	    if (m_stop)
+		return;
+
+	    generation = m_generation;
+	}
+
+	renderLines(worker);
+
+	{
+	    std::unique_lock<std::mutex> lock(m_mutex);
+
+	    if (--m_pending == 0)
+		m_doneCond.notify_all();
+	}
+    }
+}
+
+// =====================================================================================================================
+void FrameRenderer::renderLines(Worker& worker)
+{
+    RenderSnapshot& snapshot = worker.m_snapshot;
+    Renderer& renderer = worker.m_renderer;
+
+    // the memory of the snapshot was replaced
+    snapshot.copyFrom(*m_frameStart);
+
+    if (snapshot.hasPatternRam())
+	renderer.invalidatePatterns();
+
+    renderer.invalidateSprites();
+    renderer.invalidatePalette();
+
+    const std::vector<RenderLogEntry>& log = *m_log;
+    size_t next = 0;
+
+    // Visible line N is rendered at the end of scanline N + 20, so every write logged before that is applied first.
+    // Lines before the range of the worker only replay the log.
+    for (unsigned line = 0; line < worker.m_lastLine; ++line)
+    {
+	uint32_t end = (line + 20 + 1) * 341;
+
+	while (next < log.size() && log[next].m_dot < end)
+	    snapshot.apply(log[next++], renderer);
+
+	if (line >= worker.m_firstLine)
+	    renderer.renderLine(snapshot.state(), line, m_output + line * 256);
+    }
+}
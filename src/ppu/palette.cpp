@@ -9,7 +9,7 @@ PaletteMemory::PaletteMemory()
 }
 
 // =====================================================================================================================
-static inline uint16_t translateAddress(uint16_t address)
+uint16_t PaletteMemory::translateAddress(uint16_t address)
 {
     switch (address)
     {
@@ -0,0 +1,186 @@
+#include <nemu/ppu/pixelconverter.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NEMU_X86
+#include <immintrin.h>
+#endif
+
+// =====================================================================================================================
+static void convertScalar(const uint8_t* indices, uint32_t* pixels, unsigned count, const uint32_t* colors)
+{
+    for (unsigned i = 0; i < count; ++i)
+	pixels[i] = colors[indices[i] & 0x1f];
+}
+
+#ifdef NEMU_X86
+// SSE2 has no byte shuffle so the 128 bit path needs SSSE3. The colour table is split into byte planes, each plane is
+// two 16 entry tables (indices 0..15 and 16..31) looked up with pshufb, then the planes are interleaved to pixels.
+
+// =====================================================================================================================
+__attribute__((target("ssse3")))
+static void convertSsse3(const uint8_t* indices, uint32_t* pixels, unsigned count, const uint32_t* colors)
+{
+    alignas(16) uint8_t planes[4][32];
+
+    for (unsigned i = 0; i < 32; ++i)
+	for (unsigned b = 0; b < 4; ++b)
+	    planes[b][i] = colors[i] >> (b * 8);
+
+    __m128i low[4];
+    __m128i high[4];
+
+    for (unsigned b = 0; b < 4; ++b)
+    {
+	low[b] = _mm_load_si128((const __m128i*)planes[b]);
+	high[b] = _mm_load_si128((const __m128i*)(planes[b] + 16));
+    }
+
+    const __m128i mask = _mm_set1_epi8(0x1f);
+    const __m128i fifteen = _mm_set1_epi8(15);
+
+    unsigned i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+	__m128i idx = _mm_and_si128(_mm_loadu_si128((const __m128i*)(indices + i)), mask);
+	__m128i upper = _mm_cmpgt_epi8(idx, fifteen);
+
+	__m128i v[4];
+
+	for (unsigned b = 0; b < 4; ++b)
+	{
+	    __m128i l = _mm_shuffle_epi8(low[b], idx);
+	    __m128i h = _mm_shuffle_epi8(high[b], idx);
+	    v[b] = _mm_or_si128(_mm_and_si128(upper, h), _mm_andnot_si128(upper, l));
+	}
+
+	__m128i b0b1Low = _mm_unpacklo_epi8(v[0], v[1]);
+	__m128i b0b1High = _mm_unpackhi_epi8(v[0], v[1]);
+	__m128i b2b3Low = _mm_unpacklo_epi8(v[2], v[3]);
+	__m128i b2b3High = _mm_unpackhi_epi8(v[2], v[3]);
+
+	__m128i* out = (__m128i*)(pixels + i);
+	_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(b0b1Low, b2b3Low));
+	_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(b0b1Low, b2b3Low));
+	_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(b0b1High, b2b3High));
+	_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(b0b1High, b2b3High));
+    }
+
+    convertScalar(indices + i, pixels + i, count - i, colors);
+}
+
+// =====================================================================================================================
+__attribute__((target("avx2")))
+static void convertAvx2(const uint8_t* indices, uint32_t* pixels, unsigned count, const uint32_t* colors)
+{
+    alignas(16) uint8_t planes[4][32];
+
+    for (unsigned i = 0; i < 32; ++i)
+	for (unsigned b = 0; b < 4; ++b)
+	    planes[b][i] = colors[i] >> (b * 8);
+
+    // vpshufb works on 128 bit lanes so both lanes get a copy of the tables
+    __m256i low[4];
+    __m256i high[4];
+
+    for (unsigned b = 0; b < 4; ++b)
+    {
+	low[b] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)planes[b]));
+	high[b] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)(planes[b] + 16)));
+    }
+
+    const __m256i mask = _mm256_set1_epi8(0x1f);
+    const __m256i fifteen = _mm256_set1_epi8(15);
+
+    unsigned i = 0;
+
+    for (; i + 32 <= count; i += 32)
+    {
+	__m256i idx = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(indices + i)), mask);
+	__m256i upper = _mm256_cmpgt_epi8(idx, fifteen);
+
+	__m256i v[4];
+
+	for (unsigned b = 0; b < 4; ++b)
+	    v[b] = _mm256_blendv_epi8(_mm256_shuffle_epi8(low[b], idx), _mm256_shuffle_epi8(high[b], idx), upper);
+
+	__m256i b0b1Low = _mm256_unpacklo_epi8(v[0], v[1]);
+	__m256i b0b1High = _mm256_unpackhi_epi8(v[0], v[1]);
+	__m256i b2b3Low = _mm256_unpacklo_epi8(v[2], v[3]);
+	__m256i b2b3High = _mm256_unpackhi_epi8(v[2], v[3]);
+
+	// each register holds 4 pixels of the first and 4 pixels of the second 16 pixel half
+	__m256i p0 = _mm256_unpacklo_epi16(b0b1Low, b2b3Low);
+	__m256i p1 = _mm256_unpackhi_epi16(b0b1Low, b2b3Low);
+	__m256i p2 = _mm256_unpacklo_epi16(b0b1High, b2b3High);
+	__m256i p3 = _mm256_unpackhi_epi16(b0b1High, b2b3High);
+
+	__m256i* out = (__m256i*)(pixels + i);
+	_mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+	_mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+	_mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+	_mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+
+    convertScalar(indices + i, pixels + i, count - i, colors);
+}
+#endif
+
+// =====================================================================================================================
+PixelConverter::PixelConverter()
+{
+    if (isSupported(AVX2))
+	select(AVX2);
+    else if (isSupported(SSSE3))
+	select(SSSE3);
+    else
+	select(SCALAR);
+}
+
+// =====================================================================================================================
+PixelConverter::PixelConverter(Implementation implementation)
+{
+    select(isSupported(implementation) ? implementation : SCALAR);
+}
+
+// =====================================================================================================================
+PixelConverter::Implementation PixelConverter::implementation() const
+{
+    return m_implementation;
+}
+
+// =====================================================================================================================
+bool PixelConverter::isSupported(Implementation implementation)
+{
+    switch (implementation)
+    {
+	case SCALAR :
+	    return true;
+
+#ifdef NEMU_X86
+	case SSSE3 :
+	    return __builtin_cpu_supports("ssse3");
+
+	case AVX2 :
+	    return __builtin_cpu_supports("avx2");
+#endif
+
+	default :
+	    return false;
+    }
+}
+
+// =====================================================================================================================
+void PixelConverter::select(Implementation implementation)
+{
+    m_implementation = implementation;
+
+    switch (implementation)
+    {
+#ifdef NEMU_X86
+	case SSSE3 : m_convert = convertSsse3; break;
+	case AVX2 : m_convert = convertAvx2; break;
+#endif
+	default : m_convert = convertScalar; break;
+    }
+}
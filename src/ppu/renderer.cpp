@@ -0,0 +1,267 @@
+#include <nemu/ppu/renderer.h>
+#include <nemu/ppu/palette.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+const uint32_t Renderer::s_rgbPalette[64] = {
+    // 1                                                                  8
+    0x747474, 0x24188c, 0x0000a8, 0x44009c, 0x8c0074, 0xa80010, 0xa40000, 0x7c0800, 0x402c00, 0x004400, 0x005000, 0x003c14, 0x183c5c, 0x000000, 0x000000, 0x000000,
+    0xbcbcbc, 0x0070ec, 0x2038ec, 0x8000f0, 0xbc00bc, 0xe40058, 0xd82800, 0xc84c0c, 0x887000, 0x009400, 0x00a800, 0x009038, 0x008088, 0x000000, 0x000000, 0x000000,
+    0xf8f8f8, 0x3cbcfc, 0x5c94fc, 0x4088fc, 0xf478fc, 0xfc74b4, 0xfc7460, 0xfc9838, 0xf0bc3c, 0x80d010, 0x4cdc48, 0x58f898, 0x00e8d8, 0x787878, 0x000000, 0x000000,
+    0xffffff, 0xa8e4fc, 0xc4d4fc, 0xd4c8fc, 0xfcc4fc, 0xfcc4d8, 0xfcbcb0, 0xfcd8a8, 0xfce4a0, 0xe0fca0, 0xa8f0bc, 0xb0fccc, 0x9cfcf0, 0xc4c4c4, 0x000000, 0x000000
+};
+
+// =====================================================================================================================
+Renderer::Renderer()
+    : m_spritesChanged(true),
+      m_colorsChanged(true)
+{
+    memset(m_lineBuffer, 0, sizeof(m_lineBuffer));
+}
+
+// =====================================================================================================================
+void Renderer::rebuildTiles(const RenderState& state)
+{
+    syncPatterns(state);
+    m_tileCache.rebuild();
+}
+
+// =====================================================================================================================
+void Renderer::invalidatePattern(const RenderState& state, const uint8_t* data)
+{
+    // banks of pattern RAM may be switched into more than one window
+    for (unsigned i = 0; i < 8; ++i)
+    {
+	const uint8_t* window = state.m_patterns[i];
+
+	if (window && data >= window && data < window + TileCache::WINDOW_SIZE)
+	    m_tileCache.invalidate(i * TileCache::WINDOW_SIZE + (data - window));
+    }
+}
+
+// =====================================================================================================================
+void Renderer::invalidatePatterns()
+{
+    for (unsigned address = 0; address < 0x2000; address += 16)
+	m_tileCache.invalidate(address);
+}
+
+// =====================================================================================================================
+void Renderer::invalidateSprites()
+{
+    m_spritesChanged = true;
+}
+
+// =====================================================================================================================
+void Renderer::invalidatePalette()
+{
+    m_colorsChanged = true;
+}
+
+// =====================================================================================================================
+void Renderer::syncPatterns(const RenderState& state)
+{
+    // re-pointing a window invalidates only the tiles of that window
+    for (unsigned i = 0; i < 8; ++i)
+	m_tileCache.setWindow(i, state.m_patterns[i]);
+}
+
+// =====================================================================================================================
+void Renderer::updateColors(const RenderState& state)
+{
+    if (!m_colorsChanged)
+	return;
+
+    for (unsigned i = 0; i < 32; ++i)
+    {
+	m_colorIndices[i] = state.m_palette[PaletteMemory::translateAddress(i)] & 0x3f;
+	m_colors[i] = s_rgbPalette[m_colorIndices[i]];
+    }
+
+    m_colorsChanged = false;
+}
+
+// =====================================================================================================================
+void Renderer::renderBackground(const RenderState& state, unsigned line)
+{
+    syncPatterns(state);
+
+    unsigned fineX = state.m_scrollX % 8;
+    unsigned coarseX = state.m_scrollX / 8;
+
+    unsigned tileRow = line / 8;
+    unsigned fineY = line % 8;
+    unsigned attrRow = (line / 16) % 2;
+
+    // the background always uses the tiles of the second pattern table
+    unsigned tileBase = 0x100;
+
+    // The line is built from 33 tiles starting at the coarse scroll position, each tile is fetched once and expanded
+    // to 8 pixels. The fine scroll is applied by skipping the first pixels of the first tile when the line is copied.
+    uint8_t tiles[33 * 8];
+    uint8_t* data = tiles;
+
+    for (unsigned t = 0; t < 33; ++t)
+    {
+	unsigned tileCol = coarseX + t;
+
+	// crossing the right edge selects the horizontally adjacent slot, the mirroring is up to the slot pointers
+	unsigned nameTable = (state.m_ctrl & 0x3) ^ ((tileCol / 32) & 1);
+	const uint8_t* nameTableData = state.m_nameTables[nameTable];
+
+	unsigned col = tileCol % 32;
+
+	unsigned attrShift = (attrRow * 2 + (col / 2) % 2) * 2 /* 2 bit per block */;
+	uint8_t nameTableEntry = nameTableData[tileRow * 32 + col];
+	uint8_t attrData = (nameTableData[30 * 32 /* tiles */ + (line / 32) * 8 + col / 4] >> attrShift) & 0x3;
+
+	// Add the attribute bits to the 8 decoded pixels at once. The pixels are 0..3 so a byte is non-zero if one of
+	// its two low bits is set, transparent pixels have to stay zero.
+	uint64_t pixels;
+	memcpy(&pixels, m_tileCache.row(tileBase + nameTableEntry, fineY), 8);
+
+	uint64_t opaque = (pixels | (pixels >> 1)) & 0x0101010101010101ull;
+	pixels |= opaque * (attrData << 2);
+
+	memcpy(data, &pixels, 8);
+	data += 8;
+    }
+
+    memcpy(m_lineBuffer, tiles + fineX, sizeof(m_lineBuffer));
+}
+
+// =====================================================================================================================
+void Renderer::evaluateSprites(const RenderState& state)
+{
+    memset(m_lineSpriteCount, 0, sizeof(m_lineSpriteCount));
+    memset(m_lineOverflow, 0, sizeof(m_lineOverflow));
+
+    for (unsigned i = 0; i < 64; ++i)
+    {
+	unsigned y = state.m_oam[i * 4 + 0];
+
+	for (unsigned line = y; line < y + 8 && line < 240; ++line)
+	{
+	    if (m_lineSpriteCount[line] < 8)
+		m_lineSprites[line][m_lineSpriteCount[line]++] = i;
+	    else
+		m_lineOverflow[line] = true;
+	}
+    }
+
+    m_spritesChanged = false;
+}
+
+// =====================================================================================================================
+uint8_t Renderer::renderSprites(const RenderState& state, unsigned line)
+{
+    if (m_spritesChanged)
+	evaluateSprites(state);
+
+    syncPatterns(state);
+
+    uint8_t status = m_lineOverflow[line] ? SPRITE_OVERFLOW : 0;
+    unsigned count = m_lineSpriteCount[line];
+
+    if (count == 0)
+	return status;
+
+    unsigned tileBase = (state.m_ctrl & 0x8) ? 0x100 : 0x000;
+
+    // pixels already taken by a sprite with higher priority, even if it is behind the background
+    bool covered[256];
+    memset(covered, 0, sizeof(covered));
+
+    for (unsigned n = 0; n < count; ++n)
+    {
+	unsigned i = m_lineSprites[line][n];
+	const uint8_t* sprite = state.m_oam + i * 4;
+
+	uint8_t y = sprite[0];
+	uint8_t idx = sprite[1];
+	uint8_t attr = sprite[2];
+	uint8_t x = sprite[3];
+
+	bool flipHoriz = attr & 0x40;
+	bool flipVert = attr & 0x80;
+	bool behindBackground = attr & 0x20;
+
+	// find out which row of the sprite we are rendering actually
+	unsigned row = line - y;
+
+	if (flipVert)
+	    row = 7 - row;
+
+	unsigned tile = tileBase + idx;
+	const uint8_t* pixels = flipHoriz ? m_tileCache.flippedRow(tile, row) : m_tileCache.row(tile, row);
+
+	uint8_t palette = 0x10 | ((attr & 0x3) << 2);
+	unsigned width = std::min(256u - x, 8u);
+
+	for (unsigned col = 0; col < width; ++col)
+	{
+	    uint8_t pixelData = pixels[col];
+	    unsigned c = x + col;
+
+	    if (pixelData == 0 || covered[c])
+		continue;
+
+	    covered[c] = true;
+
+	    // transparent background pixels are zero in the line buffer
+	    bool background = m_lineBuffer[c] != 0;
+
+	    if (i == 0 && background)
+		status |= SPRITE0_HIT;
+
+	    if (!behindBackground || !background)
+		m_lineBuffer[c] = palette | pixelData;
+	}
+    }
+
+    return status;
+}
+
+// =====================================================================================================================
+void Renderer::output(const RenderState& state, uint32_t* pixels)
+{
+    updateColors(state);
+    m_pixelConverter.convert(m_lineBuffer, pixels, 256, m_colors);
+}
+
+// =====================================================================================================================
+void Renderer::outputIndices(const RenderState& state, uint8_t* indices)
+{
+    updateColors(state);
+
+    for (unsigned i = 0; i < 256; ++i)
+	indices[i] = m_colorIndices[m_lineBuffer[i] & 0x1f];
+}
+
+// =====================================================================================================================
+uint8_t Renderer::renderLine(const RenderState& state, unsigned line, uint32_t* pixels)
+{
+    renderBackground(state, line);
+    uint8_t status = renderSprites(state, line);
+    output(state, pixels);
+
+    return status;
+}
+
+// =====================================================================================================================
+uint8_t Renderer::evaluateStatus(const RenderState& state, unsigned line)
+{
+    if (m_spritesChanged)
+	evaluateSprites(state);
+
+    // only lines with sprite 0 need the pixels to find out about the hit
+    if (m_lineSpriteCount[line] != 0 && m_lineSprites[line][0] == 0)
+    {
+	renderBackground(state, line);
+	return renderSprites(state, line);
+    }
+
+    return m_lineOverflow[line] ? SPRITE_OVERFLOW : 0;
+}
@@ -0,0 +1,58 @@
+#include <nemu/ppu/spritememory.h>
+
+#include <string.h>
+
+// =====================================================================================================================
+SpriteMemory::SpriteMemory()
+    : RAM(SPRITES * 4),
+      m_changed(true)
+{
+    memset(data(), 0, size());
+}
+
+// =====================================================================================================================
+bool SpriteMemory::changed() const
+{
+    return m_changed;
+}
+
+// =====================================================================================================================
+void SpriteMemory::clearChanged()
+{
+    m_changed = false;
+}
+
+// =====================================================================================================================
+void SpriteMemory::markChanged()
+{
+    m_changed = true;
+}
+
+// =====================================================================================================================
+void SpriteMemory::setWriteCallback(const std::function<void(uint16_t, uint8_t)>& writeCallback)
+{
+    m_writeCallback = writeCallback;
+}
+
+// =====================================================================================================================
+void SpriteMemory::write(uint16_t address, uint8_t data)
+{
+    RAM::write(address, data);
+    m_changed = true;
+
+    if (m_writeCallback)
+	m_writeCallback(address, data);
+}
+
+// =====================================================================================================================
+void SpriteMemory::load(const uint8_t* data)
+{
+    memcpy(this->data(), data, size());
+    m_changed = true;
+
+    if (m_writeCallback)
+    {
+	for (unsigned i = 0; i < size(); ++i)
+	    m_writeCallback(i, data[i]);
+    }
+}
@@ -0,0 +1,69 @@
+#include <nemu/ppu/tilecache.h>
+
+#include <string.h>
+
+// =====================================================================================================================
+TileCache::TileCache()
+{
+    for (unsigned i = 0; i < 8; ++i)
+	m_windows[i] = nullptr;
+
+    memset(m_valid, 0, sizeof(m_valid));
+}
+
+// =====================================================================================================================
+void TileCache::setWindow(unsigned window, const uint8_t* data)
+{
+    if (m_windows[window] == data)
+	return;
+
+    m_windows[window] = data;
+
+    for (unsigned i = 0; i < TILES_PER_WINDOW; ++i)
+	m_valid[window * TILES_PER_WINDOW + i] = false;
+}
+
+// =====================================================================================================================
+void TileCache::rebuild()
+{
+    for (unsigned tile = 0; tile < TILES; ++tile)
+	decode(tile);
+}
+
+// =====================================================================================================================
+void TileCache::invalidate(uint16_t address)
+{
+    m_valid[(address / 16) % TILES] = false;
+}
+
+// =====================================================================================================================
+void TileCache::decode(unsigned tile)
+{
+    const uint8_t* window = m_windows[tile / TILES_PER_WINDOW];
+
+    m_valid[tile] = true;
+
+    // unmapped pattern memory reads as zero
+    if (!window)
+    {
+	memset(m_tiles[tile], 0, sizeof(m_tiles[tile]));
+	memset(m_flippedTiles[tile], 0, sizeof(m_flippedTiles[tile]));
+	return;
+    }
+
+    const uint8_t* data = window + (tile % TILES_PER_WINDOW) * 16;
+
+    for (unsigned row = 0; row < 8; ++row)
+    {
+	uint8_t layer1 = data[row];
+	uint8_t layer2 = data[8 + row];
+
+	for (unsigned col = 0; col < 8; ++col)
+	{
+	    uint8_t pixel = (((layer2 >> (7 - col)) & 1) << 1) | ((layer1 >> (7 - col)) & 1);
+
+	    m_tiles[tile][row][col] = pixel;
+	    m_flippedTiles[tile][row][7 - col] = pixel;
+	}
+    }
+}
@@ -0,0 +1,159 @@
+#include <nemu/presenter.h>
+#include <nemu/profiler.h>
+#include <nemu/screen.h>
+
+#include <SDL/SDL.h>
+
+// =====================================================================================================================
+Presenter::Presenter(const std::shared_ptr<GamePad>& gamepad)
+    : m_gamepad(gamepad),
+      m_frames(4),
+      m_stop(false),
+      m_quitRequested(false),
+      m_turboRequested(false),
+      m_rewindRequested(false),
+      m_hotkeys(0)
+{
+    m_thread = std::thread(&Presenter::run, this);
+}
+
+// =====================================================================================================================
+Presenter::~Presenter()
+{
+    m_stop = true;
+    m_thread.join();
+}
+
+// =====================================================================================================================
+void Presenter::submit(const uint32_t* frame)
+{
+    m_frames.push(frame);
+}
+
+// =====================================================================================================================
+bool Presenter::quitRequested() const
+{
+    return m_quitRequested;
+}
+
+// =====================================================================================================================
+bool Presenter::turboRequested() const
+{
+    return m_turboRequested;
+}
+
+// =====================================================================================================================
+bool Presenter::rewindRequested() const
+{
+    return m_rewindRequested;
+}
+
+// =====================================================================================================================
+unsigned Presenter::takeHotkeys()
+{
+    return m_hotkeys.exchange(0);
+}
+
+// =====================================================================================================================
+unsigned Presenter::droppedFrames() const
+{
+    return m_frames.dropped();
+}
+
+// =====================================================================================================================
+void Presenter::run()
+{
+    // SDL 1.2 expects the window to be created and its events to be pumped on the same thread
+    SDL_InitSubSystem(SDL_INIT_VIDEO);
+
+    {
+	Screen screen;
+
+	while (!m_stop)
+	{
+	    pollEvents();
+
+	    // present only the newest frame if the presenter fell behind
+	    while (m_frames.size() > 1)
+		m_frames.pop();
+
+	    const uint32_t* frame = m_frames.front();
+
+	    if (frame)
+	    {
+		NEMU_PROFILE_SCOPE(PRESENT);
+		screen.present(frame);
+		m_frames.pop();
+	    }
+	    else
+		SDL_Delay(1);
+	}
+    }
+
+    SDL_QuitSubSystem(SDL_INIT_VIDEO);
+}
+
+// =====================================================================================================================
+void Presenter::pollEvents()
+{
+    NEMU_PROFILE_SCOPE(INPUT);
+
+    SDL_Event event;
+
+    while (SDL_PollEvent(&event))
+    {
+	switch (event.type)
+	{
+	    case SDL_KEYDOWN :
+	    case SDL_KEYUP :
+		handleKey(event.key.keysym.sym, event.type == SDL_KEYDOWN);
+		break;
+
+	    case SDL_QUIT :
+		m_quitRequested = true;
+		break;
+	}
+    }
+}
+
+// =====================================================================================================================
+void Presenter::handleKey(int key, bool pressed)
+{
+    switch (key)
+    {
+	case SDLK_UP : m_gamepad->setButton(GamePad::UP, pressed); break;
+	case SDLK_DOWN : m_gamepad->setButton(GamePad::DOWN, pressed); break;
+	case SDLK_LEFT : m_gamepad->setButton(GamePad::LEFT, pressed); break;
+	case SDLK_RIGHT : m_gamepad->setButton(GamePad::RIGHT, pressed); break;
+	case SDLK_RETURN : m_gamepad->setButton(GamePad::START, pressed); break;
+	case SDLK_LCTRL : m_gamepad->setButton(GamePad::A, pressed); break;
+	case SDLK_SPACE : m_gamepad->setButton(GamePad::B, pressed); break;
+	case SDLK_s : m_gamepad->setButton(GamePad::SELECT, pressed); break;
+
+	case SDLK_F5 :
+	    if (pressed)
+		m_hotkeys |= SAVE_STATE;
+	    break;
+
+	case SDLK_F7 :
+	    if (pressed)
+		m_hotkeys |= LOAD_STATE;
+	    break;
+
+	case SDLK_BACKSPACE :
+	    m_rewindRequested = pressed;
+	    break;
+
+	case SDLK_TAB :
+	    m_turboRequested = pressed;
+	    break;
+
+	case SDLK_ESCAPE :
+	    if (pressed)
+		m_quitRequested = true;
+	    break;
+
+	default :
+	    break;
+    }
+}
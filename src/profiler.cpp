@@ -0,0 +1,243 @@
+#include <nemu/profiler.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+
+#include <signal.h>
+#include <time.h>
+
+using profile::Histogram;
+using profile::Profiler;
+using profile::ScopedTimer;
+
+std::atomic<bool> Profiler::s_dumpRequested(false);
+thread_local ScopedTimer* ScopedTimer::s_current = nullptr;
+
+static const char* s_sectionNames[profile::SECTION_COUNT] = {
+    "cpu (sampled)",
+    "ppu tick (sampled)",
+    "render background",
+    "render sprites",
+    "output line",
+    "sprite dma",
+    "apu",
+    "finish frame",
+    "present",
+    "input",
+    "pacing"
+};
+
+// =====================================================================================================================
+Histogram::Histogram()
+    : m_count(0),
+      m_sum(0),
+      m_max(0)
+{
+    for (unsigned i = 0; i < BUCKETS; ++i)
+	m_counts[i] = 0;
+}
+
+// =====================================================================================================================
+void Histogram::record(uint64_t value)
+{
+    ++m_counts[bucket(value)];
+    ++m_count;
+    m_sum += value;
+
+    if (value > m_max)
+	m_max = value;
+}
+
+// =====================================================================================================================
+uint64_t Histogram::count() const
+{
+    return m_count;
+}
+
+// =====================================================================================================================
+uint64_t Histogram::max() const
+{
+    return m_max;
+}
+
+// =====================================================================================================================
+double Histogram::mean() const
+{
+    return m_count ? double(m_sum) / m_count : 0;
+}
+
+// =====================================================================================================================
+uint64_t Histogram::percentile(double fraction) const
+{
+    if (m_count == 0)
+	return 0;
+
+    uint64_t rank = fraction * m_count;
+    uint64_t seen = 0;
+
+    for (unsigned i = 0; i < BUCKETS; ++i)
+    {
+	seen += m_counts[i];
+
+	// the middle of the bucket
+	if (seen > rank)
+	    return i + 1 < BUCKETS ? std::min((bucketValue(i) + bucketValue(i + 1)) / 2, m_max) : m_max;
+    }
+
+    return m_max;
+}
+
+// =====================================================================================================================
+unsigned Histogram::bucket(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+	return value;
+
+    // the position of the highest bit selects the power of two, the 4 bits below it the sub bucket
+    unsigned exponent = 63 - __builtin_clzll(value);
+
+    return SUB_BUCKETS + (exponent - 4) * SUB_BUCKETS + ((value >> (exponent - 4)) & (SUB_BUCKETS - 1));
+}
+
+// =====================================================================================================================
+uint64_t Histogram::bucketValue(unsigned bucket)
+{
+    if (bucket < SUB_BUCKETS)
+	return bucket;
+
+    unsigned exponent = (bucket - SUB_BUCKETS) / SUB_BUCKETS + 4;
+    uint64_t sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+
+    return (SUB_BUCKETS + sub) << (exponent - 4);
+}
+
+// =====================================================================================================================
+Profiler& Profiler::instance()
+{
+    static Profiler s_profiler;
+    return s_profiler;
+}
+
+// =====================================================================================================================
+Profiler::Profiler()
+    : m_frameStart(now())
+{
+    for (unsigned i = 0; i < SECTION_COUNT; ++i)
+	m_frameSums[i] = 0;
+
+    // the median of back to back clock reads, stable to a few nanoseconds
+    std::vector<uint64_t> samples;
+
+    for (unsigned i = 0; i < 1001; ++i)
+    {
+	uint64_t start = now();
+	samples.push_back(now() - start);
+    }
+
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    m_timerOverhead = samples[samples.size() / 2];
+
+    signal(SIGUSR1, handleSignal);
+}
+
+// =====================================================================================================================
+void Profiler::add(Section section, uint64_t nanoseconds)
+{
+    m_frameSums[section].fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+void Profiler::endFrame()
+{
+    for (unsigned i = 0; i < SECTION_COUNT; ++i)
+	m_histograms[i].record(m_frameSums[i].exchange(0, std::memory_order_relaxed));
+
+    uint64_t time = now();
+    m_frameTimes.record(time - m_frameStart);
+    m_frameStart = time;
+}
+
+// =====================================================================================================================
+bool Profiler::dumpRequested()
+{
+    return s_dumpRequested.exchange(false, std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+void Profiler::dump(std::ostream& stream) const
+{
+    std::ios::fmtflags flags = stream.flags();
+
+    stream << "Frame time breakdown over " << m_frameTimes.count() << " frames (ms per frame)" << std::endl;
+    stream << std::left << std::setw(20) << "section" << std::right
+	   << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "max"
+	   << std::endl;
+
+    stream << std::fixed << std::setprecision(3);
+
+    for (unsigned i = 0; i <= SECTION_COUNT; ++i)
+    {
+	const Histogram& h = i < SECTION_COUNT ? m_histograms[i] : m_frameTimes;
+
+	stream << std::left << std::setw(20) << (i < SECTION_COUNT ? s_sectionNames[i] : "frame") << std::right
+	       << std::setw(10) << h.mean() / 1e6
+	       << std::setw(10) << h.percentile(0.5) / 1e6
+	       << std::setw(10) << h.percentile(0.99) / 1e6
+	       << std::setw(10) << h.max() / 1e6
+	       << std::endl;
+    }
+
+    stream.flags(flags);
+}
+
+// =====================================================================================================================
+uint64_t Profiler::timerOverhead() const
+{
+    return m_timerOverhead;
+}
+
+// =====================================================================================================================
+uint64_t Profiler::now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// =====================================================================================================================
+void Profiler::handleSignal(int signal)
+{
+    // only the flag is set here, the dump happens at the end of the next frame
+    s_dumpRequested.store(true, std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+ScopedTimer::ScopedTimer(Section section, unsigned weight)
+    : m_section(section),
+      m_weight(weight),
+      m_start(Profiler::now()),
+      m_nested(0),
+      m_parent(s_current)
+{
+    s_current = this;
+}
+
+// =====================================================================================================================
+ScopedTimer::~ScopedTimer()
+{
+    uint64_t elapsed = Profiler::now() - m_start;
+
+    s_current = m_parent;
+
+    if (m_parent)
+	m_parent->m_nested += elapsed;
+
+    Profiler& profiler = Profiler::instance();
+    uint64_t own = elapsed - m_nested;
+
+    own = own > profiler.timerOverhead() ? own - profiler.timerOverhead() : 0;
+
+    profiler.add(m_section, own * m_weight);
+}
@@ -0,0 +1,225 @@
+#include <nemu/rewindbuffer.h>
+
+#include <string.h>
+
+// =====================================================================================================================
+static inline void writeLength(std::vector<uint8_t>& output, size_t length)
+{
+    // 7 bits per byte, the high bit marks that more bytes follow
+    while (length >= 0x80)
+    {
+	output.push_back((length & 0x7f) | 0x80);
+	length >>= 7;
+    }
+
+    output.push_back(length);
+}
+
+// =====================================================================================================================
+static inline size_t readLength(const uint8_t*& input)
+{
+    size_t length = 0;
+    unsigned shift = 0;
+
+    while (*input & 0x80)
+    {
+	length |= size_t(*input++ & 0x7f) << shift;
+	shift += 7;
+    }
+
+    length |= size_t(*input++) << shift;
+
+    return length;
+}
+
+// =====================================================================================================================
+RewindBuffer::RewindBuffer(size_t budget, unsigned keyframeInterval)
+    : m_budget(budget),
+      m_keyframeInterval(keyframeInterval),
+      m_usedBytes(0),
+      m_sinceKeyframe(0)
+{
+}
+
+// =====================================================================================================================
+void RewindBuffer::push(const std::vector<uint8_t>& state)
+{
+    Entry entry;
+    entry.m_size = state.size();
+    entry.m_keyframe = m_keyframe.size() != state.size() || m_sinceKeyframe + 1 >= m_keyframeInterval;
+
+    if (entry.m_keyframe)
+    {
+	encode(state.data(), nullptr, state.size(), m_encoded);
+	m_keyframe = state;
+	m_sinceKeyframe = 0;
+    }
+    else
+    {
+	encode(state.data(), m_keyframe.data(), state.size(), m_encoded);
+	++m_sinceKeyframe;
+    }
+
+    entry.m_data.assign(m_encoded.begin(), m_encoded.end());
+
+    m_usedBytes += entry.m_data.size();
+    m_entries.push_back(std::move(entry));
+
+    // the group the new state belongs to is never dropped
+    while (m_usedBytes > m_budget && m_entries.size() > m_sinceKeyframe + 1)
+	dropOldest();
+}
+
+// =====================================================================================================================
+bool RewindBuffer::pop(std::vector<uint8_t>& state)
+{
+    if (m_entries.empty())
+	return false;
+
+    Entry& entry = m_entries.back();
+
+    state.resize(entry.m_size);
+    decode(entry.m_data, entry.m_keyframe ? nullptr : m_keyframe.data(), state.data(), state.size());
+
+    bool keyframe = entry.m_keyframe;
+
+    m_usedBytes -= entry.m_data.size();
+    m_entries.pop_back();
+
+    // the deltas before a keyframe refer to the keyframe before it
+    if (keyframe)
+	decodeKeyframe();
+    else
+	--m_sinceKeyframe;
+
+    return true;
+}
+
+// =====================================================================================================================
+size_t RewindBuffer::size() const
+{
+    return m_entries.size();
+}
+
+// =====================================================================================================================
+size_t RewindBuffer::usedBytes() const
+{
+    return m_usedBytes;
+}
+
+// =====================================================================================================================
+void RewindBuffer::dropOldest()
+{
+    do
+    {
+	m_usedBytes -= m_entries.front().m_data.size();
+	m_entries.pop_front();
+    }
+    while (!m_entries.empty() && !m_entries.front().m_keyframe);
+}
+
+// =====================================================================================================================
+void RewindBuffer::decodeKeyframe()
+{
+    m_sinceKeyframe = 0;
+
+    for (size_t i = m_entries.size(); i > 0; --i)
+    {
+	const Entry& entry = m_entries[i - 1];
+
+	if (entry.m_keyframe)
+	{
+	    m_keyframe.resize(entry.m_size);
+	    decode(entry.m_data, nullptr, m_keyframe.data(), m_keyframe.size());
+	    return;
+	}
+
+	++m_sinceKeyframe;
+    }
+
+    // only deltas without their keyframe are left, which cannot happen as groups are dropped as a whole
+    m_keyframe.clear();
+}
+
+// =====================================================================================================================
+void RewindBuffer::encode(const uint8_t* state, const uint8_t* reference, size_t size, std::vector<uint8_t>& output)
+{
+    // The XOR against the reference is encoded as pairs of a zero run and a literal run, each introduced by its
+    // length. Zero runs are found a machine word at a time.
+    output.clear();
+
+    size_t position = 0;
+
+    while (position < size)
+    {
+	size_t start = position;
+
+	while (position + 8 <= size)
+	{
+	    uint64_t a, b = 0;
+	    memcpy(&a, state + position, 8);
+	    if (reference)
+		memcpy(&b, reference + position, 8);
+
+	    if (a != b)
+		break;
+
+	    position += 8;
+	}
+
+	while (position < size && state[position] == (reference ? reference[position] : 0))
+	    ++position;
+
+	writeLength(output, position - start);
+
+	// literals end at the first run of at least 4 zero bytes, shorter runs are cheaper to store as literals
+	start = position;
+	unsigned zeros = 0;
+
+	while (position < size && zeros < 4)
+	{
+	    if (state[position] == (reference ? reference[position] : 0))
+		++zeros;
+	    else
+		zeros = 0;
+
+	    ++position;
+	}
+
+	if (zeros == 4)
+	    position -= 4;
+	else if (position == size)
+	    position -= zeros;
+
+	writeLength(output, position - start);
+
+	for (size_t i = start; i < position; ++i)
+	    output.push_back(state[i] ^ (reference ? reference[i] : 0));
+    }
+}
+
+// =====================================================================================================================
+void RewindBuffer::decode(const std::vector<uint8_t>& input, const uint8_t* reference, uint8_t* state, size_t size)
+{
+    if (reference)
+	memcpy(state, reference, size);
+    else
+	memset(state, 0, size);
+
+    const uint8_t* data = input.data();
+    const uint8_t* end = data + input.size();
+    size_t position = 0;
+
+    while (data < end)
+    {
+	position += readLength(data);
+
+	size_t literals = readLength(data);
+
+	for (size_t i = 0; i < literals; ++i)
+	    state[position + i] ^= data[i];
+
+	data += literals;
+	position += literals;
+    }
+}
@@ -0,0 +1,24 @@
+#include <nemu/screen.h>
+
+#include <string.h>
+
+// =====================================================================================================================
+Screen::Screen()
+{
+    m_surface = SDL_SetVideoMode(WIDTH, HEIGHT, 32, SDL_SWSURFACE);
+}
+
+// =====================================================================================================================
+void Screen::present(const uint32_t* frame)
+{
+    if (SDL_MUSTLOCK(m_surface))
+	SDL_LockSurface(m_surface);
+
+    for (unsigned line = 0; line < HEIGHT; ++line)
+	memcpy((uint8_t*)m_surface->pixels + line * m_surface->pitch, frame + line * WIDTH, WIDTH * sizeof(uint32_t));
+
+    if (SDL_MUSTLOCK(m_surface))
+	SDL_UnlockSurface(m_surface);
+
+    SDL_Flip(m_surface);
+}
@@ -0,0 +1,51 @@
+#include <nemu/spritedma.h>
+#include <nemu/profiler.h>
+
+#include <stdlib.h>
+
+// =====================================================================================================================
+SpriteDMA::SpriteDMA(memory::Dispatcher& memory, SpriteMemory& spriteRam, const uint64_t& cycles)
+    : m_memory(memory),
+      m_spriteRam(spriteRam),
+      m_cycles(cycles)
+{
+}
+
+// =====================================================================================================================
+void SpriteDMA::setStallCallback(const std::function<void(unsigned)>& stallCallback)
+{
+    m_stallCallback = stallCallback;
+}
+
+// =====================================================================================================================
+uint8_t SpriteDMA::read(uint16_t address)
+{
+    abort();
+}
+
+// =====================================================================================================================
+void SpriteDMA::write(uint16_t address, uint8_t data)
+{
+    NEMU_PROFILE_SCOPE(SPRITE_DMA);
+
+    const uint8_t* page = m_memory.readPage(data);
+
+    if (page)
+	m_spriteRam.load(page);
+    else
+    {
+	// the reads of I/O registers may have side effects
+	uint16_t base = data * 0x100;
+
+	uint8_t buffer[256];
+
+	for (unsigned i = 0; i < 256; ++i)
+	    buffer[i] = m_memory.read(base + i);
+
+	m_spriteRam.load(buffer);
+    }
+
+    // 256 read and write cycles, one to halt the CPU and one more to align to a read cycle on odd cycles
+    if (m_stallCallback)
+	m_stallCallback(513 + (m_cycles & 1));
+}
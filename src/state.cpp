@@ -0,0 +1,54 @@
+#include <nemu/state.h>
+
+// =====================================================================================================================
+StateWriter::StateWriter(std::vector<uint8_t>& buffer)
+    : m_buffer(buffer)
+{
+}
+
+// =====================================================================================================================
+void StateWriter::beginSection(const char* tag)
+{
+    write(tag, 4);
+}
+
+// =====================================================================================================================
+void StateWriter::write(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+}
+
+// =====================================================================================================================
+StateReader::StateReader(const uint8_t* data, size_t size)
+    : m_data(data),
+      m_size(size),
+      m_position(0)
+{
+}
+
+// =====================================================================================================================
+void StateReader::beginSection(const char* tag)
+{
+    char found[4];
+    read(found, sizeof(found));
+
+    if (memcmp(found, tag, sizeof(found)) != 0)
+	throw StateException(std::string("missing state section: ") + std::string(tag, 4));
+}
+
+// =====================================================================================================================
+void StateReader::read(void* data, size_t size)
+{
+    if (size > m_size - m_position)
+	throw StateException("truncated state");
+
+    memcpy(data, m_data + m_position, size);
+    m_position += size;
+}
+
+// =====================================================================================================================
+bool StateReader::atEnd() const
+{
+    return m_position == m_size;
+}
@@ -0,0 +1,317 @@
+#include <nemu/videorecorder.h>
+#include <nemu/ppu/renderer.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+const char VideoRecorder::s_magic[4] = {'N', 'V', 'I', 'D'};
+const uint32_t VideoRecorder::s_version;
+
+/// about a second of frames, enough to ride out a stalled disk
+static const unsigned QUEUE_FRAMES = 64;
+/// the output is written once this much is buffered
+static const size_t WRITE_SIZE = 1 << 20;
+/// a key frame is written at least this often so the converter can start anywhere
+static const unsigned KEY_INTERVAL = 300;
+/// a run of unchanged pixels shorter than this is cheaper to encode as changed pixels
+static const unsigned MIN_SKIP = 4;
+
+// =====================================================================================================================
+static void putVarint(std::vector<uint8_t>& output, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+	output.push_back(uint8_t(value) | 0x80);
+	value >>= 7;
+    }
+
+    output.push_back(uint8_t(value));
+}
+
+// =====================================================================================================================
+VideoRecorder::VideoRecorder(const std::string& file)
+    : m_capacity(QUEUE_FRAMES),
+      m_buffers(QUEUE_FRAMES * FRAME_SIZE),
+      m_frameNumbers(QUEUE_FRAMES),
+      m_head(0),
+      m_tail(0),
+      m_dropped(0),
+      m_sequence(0),
+      m_previous(FRAME_SIZE),
+      m_sinceKey(0),
+      m_offset(0),
+      m_frames(0),
+      m_error(0),
+      m_stop(false)
+{
+    m_fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (m_fd < 0)
+	throw std::system_error(errno, std::system_category(), file);
+
+    std::string indexFile = file + ".idx";
+    m_indexFd = ::open(indexFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (m_indexFd < 0)
+    {
+	int error = errno;
+	::close(m_fd);
+	throw std::system_error(error, std::system_category(), indexFile);
+    }
+
+    // room for a full write and the frame crossing it
+    m_output.reserve(WRITE_SIZE + sizeof(VideoFrameHeader) + FRAME_SIZE);
+    m_index.reserve(4096);
+
+    VideoHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.m_magic, s_magic, sizeof(s_magic));
+    header.m_version = s_version;
+    header.m_width = WIDTH;
+    header.m_height = HEIGHT;
+    // 1.789773 MHz / 29780.5 CPU cycles per frame
+    header.m_rateNumerator = 39375000;
+    header.m_rateDenominator = 655171;
+
+    for (unsigned i = 0; i < 64; ++i)
+	header.m_palette[i] = Renderer::rgbColor(i);
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+    m_output.insert(m_output.end(), bytes, bytes + sizeof(header));
+
+    m_thread = std::thread(&VideoRecorder::run, this);
+}
+
+// =====================================================================================================================
+VideoRecorder::~VideoRecorder()
+{
+    finish();
+
+    ::close(m_fd);
+    ::close(m_indexFd);
+}
+
+// =====================================================================================================================
+void VideoRecorder::finish()
+{
+    if (!m_thread.joinable())
+	return;
+
+    {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stop = true;
+    }
+
+    m_cond.notify_one();
+    m_thread.join();
+}
+
+// =====================================================================================================================
+bool VideoRecorder::submit(const uint8_t* frame)
+{
+    uint32_t frameNumber = m_sequence++;
+    unsigned tail = m_tail.load(std::memory_order_relaxed);
+
+    if (tail - m_head.load(std::memory_order_acquire) == m_capacity)
+    {
+	m_dropped.fetch_add(1, std::memory_order_relaxed);
+	return false;
+    }
+
+    unsigned slot = tail % m_capacity;
+    memcpy(&m_buffers[slot * FRAME_SIZE], frame, FRAME_SIZE);
+    m_frameNumbers[slot] = frameNumber;
+
+    m_tail.store(tail + 1, std::memory_order_release);
+
+    // Notifying without the mutex may miss a writer about to sleep, it wakes up on its timeout then. Taking the mutex
+    // could block the emulation thread behind the writer.
+    m_cond.notify_one();
+
+    return true;
+}
+
+// =====================================================================================================================
+void VideoRecorder::skip()
+{
+    ++m_sequence;
+}
+
+// =====================================================================================================================
+uint64_t VideoRecorder::frames() const
+{
+    return m_frames.load(std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+unsigned VideoRecorder::dropped() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+int VideoRecorder::error() const
+{
+    return m_error.load(std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+void VideoRecorder::run()
+{
+    for (;;)
+    {
+	unsigned head = m_head.load(std::memory_order_relaxed);
+
+	if (head == m_tail.load(std::memory_order_acquire))
+	{
+	    if (m_stop)
+		break;
+
+	    std::unique_lock<std::mutex> lock(m_mutex);
+	    m_cond.wait_for(lock, std::chrono::milliseconds(10), [this, head]() {
+		return m_stop || m_tail.load(std::memory_order_acquire) != head;
+	    });
+
+	    continue;
+	}
+
+	unsigned slot = head % m_capacity;
+	encode(&m_buffers[slot * FRAME_SIZE], m_frameNumbers[slot]);
+
+	// the buffer is free again once the frame is encoded
+	m_head.store(head + 1, std::memory_order_release);
+
+	if (m_output.size() >= WRITE_SIZE)
+	    flush();
+    }
+
+    flush();
+}
+
+// =====================================================================================================================
+void VideoRecorder::encode(const uint8_t* frame, uint32_t frameNumber)
+{
+    size_t start = m_output.size();
+
+    VideoIndexEntry entry;
+    entry.m_frame = frameNumber;
+    entry.m_offset = m_offset + start;
+
+    m_output.resize(start + sizeof(VideoFrameHeader));
+
+    bool key = m_frames == 0 || m_sinceKey + 1 >= KEY_INTERVAL;
+
+    if (!key)
+    {
+	unsigned pos = 0;
+
+	while (pos < FRAME_SIZE)
+	{
+	    unsigned skip = pos;
+
+	    while (skip < FRAME_SIZE && frame[skip] == m_previous[skip])
+		++skip;
+
+	    if (skip == FRAME_SIZE)
+		break;
+
+	    // the changed pixels continue until a run of unchanged ones long enough to be skipped
+	    unsigned end = skip;
+
+	    while (end < FRAME_SIZE)
+	    {
+		if (frame[end] != m_previous[end])
+		{
+		    ++end;
+		    continue;
+		}
+
+		unsigned same = end;
+
+		while (same < FRAME_SIZE && frame[same] == m_previous[same])
+		    ++same;
+
+		if (same - end >= MIN_SKIP || same == FRAME_SIZE)
+		    break;
+
+		end = same;
+	    }
+
+	    putVarint(m_output, skip - pos);
+	    putVarint(m_output, end - skip);
+	    m_output.insert(m_output.end(), frame + skip, frame + end);
+
+	    pos = end;
+
+	    // frame differencing does not help for this frame
+	    if (m_output.size() - start - sizeof(VideoFrameHeader) >= FRAME_SIZE)
+	    {
+		m_output.resize(start + sizeof(VideoFrameHeader));
+		key = true;
+		break;
+	    }
+	}
+    }
+
+    if (key)
+    {
+	m_output.insert(m_output.end(), frame, frame + FRAME_SIZE);
+	m_sinceKey = 0;
+    }
+    else
+	++m_sinceKey;
+
+    VideoFrameHeader header;
+    header.m_frame = frameNumber;
+    header.m_type = key ? VideoFrameHeader::KEY : VideoFrameHeader::DELTA;
+    header.m_size = m_output.size() - start - sizeof(VideoFrameHeader);
+    memcpy(&m_output[start], &header, sizeof(header));
+
+    entry.m_type = header.m_type;
+    m_index.push_back(entry);
+
+    memcpy(m_previous.data(), frame, FRAME_SIZE);
+    m_frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+void VideoRecorder::flush()
+{
+    writeAll(m_fd, m_output.data(), m_output.size());
+    writeAll(m_indexFd, m_index.data(), m_index.size() * sizeof(VideoIndexEntry));
+
+    m_offset += m_output.size();
+    m_output.clear();
+    m_index.clear();
+}
+
+// =====================================================================================================================
+void VideoRecorder::writeAll(int fd, const void* data, size_t size)
+{
+    if (m_error != 0)
+	return;
+
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+
+    while (size != 0)
+    {
+	ssize_t written = ::write(fd, p, size);
+
+	if (written < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+
+	    m_error = errno;
+	    return;
+	}
+
+	p += written;
+	size -= written;
+    }
+}
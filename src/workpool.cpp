@@ -0,0 +1,172 @@
+#include <nemu/workpool.h>
+
+#include <algorithm>
+
+// =====================================================================================================================
+WorkPool::WorkPool(unsigned threads)
+    : m_queued(0),
+      m_pending(0),
+      m_next(0),
+      m_stop(false)
+{
+    if (threads == 0)
+	threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned i = 0; i < threads; ++i)
+	m_workers.push_back(std::unique_ptr<Worker>(new Worker()));
+
+    for (unsigned i = 0; i < threads; ++i)
+	m_workers[i]->m_thread = std::thread(&WorkPool::work, this, i);
+}
+
+// =====================================================================================================================
+WorkPool::~WorkPool()
+{
+    wait();
+
+    {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_stop = true;
+    }
+
+    m_taskCond.notify_all();
+
+    for (auto& worker : m_workers)
+	worker->m_thread.join();
+}
+
+// =====================================================================================================================
+unsigned WorkPool::threads() const
+{
+    return m_workers.size();
+}
+
+// =====================================================================================================================
+void WorkPool::submit(const std::function<void()>& task)
+{
+    push(task, nullptr);
+}
+
+// =====================================================================================================================
+void WorkPool::submit(TaskGroup& group, const std::function<void()>& task)
+{
+    push(task, &group);
+}
+
+// =====================================================================================================================
+void WorkPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCond.wait(lock, [this]() { return m_pending == 0; });
+}
+
+// =====================================================================================================================
+void WorkPool::wait(TaskGroup& group)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCond.wait(lock, [&group]() { return group.m_pending == 0; });
+}
+
+// =====================================================================================================================
+void WorkPool::push(const std::function<void()>& task, TaskGroup* group)
+{
+    Task entry = {task, group};
+    Worker& worker = *m_workers[m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size()];
+
+    // counted before it is queued so a worker finishing it at once never takes the counts below zero
+    {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	++m_queued;
+	++m_pending;
+
+	if (group)
+	    ++group->m_pending;
+    }
+
+    try
+    {
+	std::unique_lock<std::mutex> lock(worker.m_mutex);
+	worker.m_tasks.push_back(std::move(entry));
+    }
+    catch (...)
+    {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	--m_queued;
+	--m_pending;
+
+	if (group)
+	    --group->m_pending;
+
+	throw;
+    }
+
+    m_taskCond.notify_one();
+}
+
+// =====================================================================================================================
+void WorkPool::work(unsigned index)
+{
+    Task task;
+
+    while (true)
+    {
+	if (takeTask(index, task))
+	{
+	    {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		--m_queued;
+	    }
+
+	    task.m_function();
+	    task.m_function = nullptr;
+
+	    std::unique_lock<std::mutex> lock(m_mutex);
+
+	    bool groupDone = task.m_group && --task.m_group->m_pending == 0;
+
+	    if (--m_pending == 0 || groupDone)
+		m_doneCond.notify_all();
+
+	    continue;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_taskCond.wait(lock, [this]() { return m_stop || m_queued > 0; });
+
+	if (m_stop)
+	    return;
+    }
+}
+
+// =====================================================================================================================
+bool WorkPool::takeTask(unsigned index, Task& task)
+{
+    // the newest task of the own queue, its data is most likely still in the cache
+    {
+	Worker& own = *m_workers[index];
+	std::unique_lock<std::mutex> lock(own.m_mutex);
+
+	if (!own.m_tasks.empty())
+	{
+	    task = std::move(own.m_tasks.back());
+	    own.m_tasks.pop_back();
+	    return true;
+	}
+    }
+
+    // the oldest task of another queue, starting with the next worker to spread the thieves
+    for (unsigned i = 1; i < m_workers.size(); ++i)
+    {
+	Worker& victim = *m_workers[(index + i) % m_workers.size()];
+	std::unique_lock<std::mutex> lock(victim.m_mutex);
+
+	if (!victim.m_tasks.empty())
+	{
+	    task = std::move(victim.m_tasks.front());
+	    victim.m_tasks.pop_front();
+	    return true;
+	}
+    }
+
+    return false;
+}
@@ -0,0 +1,280 @@
+#include <nemu/machine.h>
+#include <nemu/movie.h>
+#include <nemu/workpool.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <getopt.h>
+
+// Runs a list of ROM/movie/frame count jobs on a work-stealing pool with one isolated machine per job and reports the
+// hash of the last frame and the throughput of each job as JSON lines.
+
+struct Job
+{
+    std::string m_rom;
+    /// played from power on, empty runs without input
+    std::string m_movie;
+    /// number of frames to run, 0 runs until the end of the movie
+    unsigned m_frames;
+
+    // results
+    std::string m_error;
+    unsigned m_framesRun;
+    uint64_t m_frameHash;
+    double m_wallTime;
+};
+
+// =====================================================================================================================
+static std::string quote(const std::string& text)
+{
+    std::string quoted = "\"";
+
+    for (char c : text)
+    {
+	if (c == '"' || c == '\\')
+	    quoted += '\\';
+
+	quoted += c;
+    }
+
+    return quoted + "\"";
+}
+
+// =====================================================================================================================
+static uint64_t hashFrame(const uint32_t* frame)
+{
+    // FNV-1a over the pixels
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (unsigned i = 0; i < 256 * 240; ++i)
+    {
+	hash ^= frame[i];
+	hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+// =====================================================================================================================
+static void runJob(Job& job, const Loader& cartridge)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    try
+    {
+	Machine machine(cartridge);
+	PPU& ppu = machine.ppu();
+
+	Movie movie;
+	uint8_t input = 0;
+
+	if (!job.m_movie.empty())
+	{
+	    std::ifstream f(job.m_movie.c_str(), std::ios::binary);
+
+	    if (!f)
+		throw StateException("unable to open movie " + job.m_movie);
+
+	    movie.load(std::vector<uint8_t>((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>()));
+
+	    if (movie.romCrc() != cartridge.crc32())
+		throw StateException("movie was recorded on a different ROM");
+
+	    if (movie.startFrame() != ppu.frameCount())
+		throw StateException("movie does not start at power on");
+
+	    if (job.m_frames == 0)
+		job.m_frames = movie.length();
+
+	    machine.gamepad()->setInputCallback([&input]() { return input; });
+	}
+
+	ppu.setFrameCallback([&job](const uint32_t* frame) { job.m_frameHash = hashFrame(frame); });
+
+	// only the last frame is rendered, the others evaluate the status flags the game sees
+	ppu.setVideoOutput(false);
+
+	for (job.m_framesRun = 0; job.m_framesRun < job.m_frames; ++job.m_framesRun)
+	{
+	    if (!job.m_movie.empty() && !movie.input(ppu.frameCount(), input))
+		input = 0;
+
+	    if (job.m_framesRun + 1 == job.m_frames)
+		ppu.setVideoOutput(true);
+
+	    machine.runFrame();
+	}
+    }
+    catch (const std::exception& e)
+    {
+	job.m_error = e.what();
+    }
+    catch (...)
+    {
+	// nothing may escape to the worker thread, it would terminate the whole batch
+	job.m_error = "unknown exception";
+    }
+
+    job.m_wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// =====================================================================================================================
+static bool readJobs(std::istream& input, std::vector<Job>& jobs)
+{
+    std::string line;
+    unsigned number = 0;
+
+    while (std::getline(input, line))
+    {
+	++number;
+
+	if (line.empty() || line[0] == '#')
+	    continue;
+
+	// ROM FRAMES [MOVIE]
+	std::istringstream fields(line);
+	Job job = Job();
+
+	if (!(fields >> job.m_rom >> job.m_frames))
+	{
+	    fprintf(stderr, "line %u: expected ROM FRAMES [MOVIE]\n", number);
+	    return false;
+	}
+
+	fields >> job.m_movie;
+
+	if (job.m_frames == 0 && job.m_movie.empty())
+	{
+	    fprintf(stderr, "line %u: a job without movie needs a frame count\n", number);
+	    return false;
+	}
+
+	jobs.push_back(job);
+    }
+
+    return true;
+}
+
+// =====================================================================================================================
+int main(int argc, char** argv)
+{
+    static const option options[] = {
+	{"threads", required_argument, nullptr, 't'},
+	{nullptr, 0, nullptr, 0}
+    };
+
+    unsigned threads = 0;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1)
+    {
+	switch (opt)
+	{
+	    case 't' :
+		threads = strtoul(optarg, nullptr, 10);
+		break;
+
+	    default :
+		fprintf(stderr, "Usage: %s [--threads N] jobs\n", argv[0]);
+		return 1;
+	}
+    }
+
+    if (optind != argc - 1)
+    {
+	fprintf(stderr, "Usage: %s [--threads N] jobs\n", argv[0]);
+	return 1;
+    }
+
+    std::vector<Job> jobs;
+    std::ifstream jobFile(argv[optind]);
+
+    if (!jobFile || !readJobs(jobFile, jobs))
+    {
+	fprintf(stderr, "Unable to read jobs: %s\n", argv[optind]);
+	return 1;
+    }
+
+    // every ROM is mapped once, the machines of all its jobs share the read only images
+    std::map<std::string, std::shared_ptr<Loader>> cartridges;
+
+    for (Job& job : jobs)
+    {
+	if (cartridges.count(job.m_rom))
+	    continue;
+
+	std::shared_ptr<Loader> loader = std::make_shared<Loader>();
+
+	try
+	{
+	    loader->load(job.m_rom);
+	}
+	catch (const LoaderException& e)
+	{
+	    loader.reset();
+	    fprintf(stderr, "%s\n", e.what());
+	}
+
+	cartridges[job.m_rom] = loader;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    {
+	WorkPool pool(threads);
+
+	for (Job& job : jobs)
+	{
+	    const std::shared_ptr<Loader>& cartridge = cartridges[job.m_rom];
+
+	    if (!cartridge)
+	    {
+		job.m_error = "unable to load ROM";
+		continue;
+	    }
+
+	    pool.submit([&job, &cartridge]() { runJob(job, *cartridge); });
+	}
+
+	threads = pool.threads();
+	pool.wait();
+    }
+
+    double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t totalFrames = 0;
+    unsigned failed = 0;
+
+    for (unsigned i = 0; i < jobs.size(); ++i)
+    {
+	const Job& job = jobs[i];
+
+	printf("{\"job\": %u, \"rom\": %s, \"movie\": %s", i, quote(job.m_rom).c_str(), quote(job.m_movie).c_str());
+
+	if (job.m_error.empty())
+	{
+	    printf(", \"frames\": %u, \"frame_hash\": \"%016llx\", \"wall_time_s\": %.6f, \"frames_per_s\": %.1f}\n",
+		   job.m_framesRun, (unsigned long long)job.m_frameHash, job.m_wallTime,
+		   job.m_wallTime > 0 ? job.m_framesRun / job.m_wallTime : 0);
+	}
+	else
+	{
+	    printf(", \"error\": %s}\n", quote(job.m_error).c_str());
+	    ++failed;
+	}
+
+	totalFrames += job.m_framesRun;
+    }
+
+    printf("{\"jobs\": %zu, \"failed\": %u, \"threads\": %u, \"frames\": %llu, \"wall_time_s\": %.6f, "
+	   "\"frames_per_s\": %.1f}\n", jobs.size(), failed, threads, (unsigned long long)totalFrames, wallTime,
+	   wallTime > 0 ? totalFrames / wallTime : 0);
+
+    return failed ? 1 : 0;
+}
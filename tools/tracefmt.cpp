@@ -0,0 +1,186 @@
+#include <nemu/cputrace.h>
+#include <nemu/memory/mappedfile.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+
+#include <getopt.h>
+
+// Formats the binary instruction trace written by nemu --trace as text, oldest instruction first.
+
+enum Mode
+{
+    IMP,
+    ACC,
+    IMM,
+    ZP,
+    ZPX,
+    ZPY,
+    ABS,
+    ABX,
+    ABY,
+    IND,
+    IZX,
+    IZY,
+    REL
+};
+
+struct Opcode
+{
+    const char* m_mnemonic;
+    Mode m_mode;
+};
+
+// unofficial opcodes are shown as ???
+static const Opcode s_opcodes[256] = {
+    {"BRK", IMP}, {"ORA", IZX}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"ORA", ZP}, {"ASL", ZP}, {"???", IMP},
+    {"PHP", IMP}, {"ORA", IMM}, {"ASL", ACC}, {"???", IMP}, {"???", IMP}, {"ORA", ABS}, {"ASL", ABS}, {"???", IMP},
+    {"BPL", REL}, {"ORA", IZY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"ORA", ZPX}, {"ASL", ZPX}, {"???", IMP},
+    {"CLC", IMP}, {"ORA", ABY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"ORA", ABX}, {"ASL", ABX}, {"???", IMP},
+    {"JSR", ABS}, {"AND", IZX}, {"???", IMP}, {"???", IMP}, {"BIT", ZP}, {"AND", ZP}, {"ROL", ZP}, {"???", IMP},
+    {"PLP", IMP}, {"AND", IMM}, {"ROL", ACC}, {"???", IMP}, {"BIT", ABS}, {"AND", ABS}, {"ROL", ABS}, {"???", IMP},
+    {"BMI", REL}, {"AND", IZY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"AND", ZPX}, {"ROL", ZPX}, {"???", IMP},
+    {"SEC", IMP}, {"AND", ABY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"AND", ABX}, {"ROL", ABX}, {"???", IMP},
+    {"RTI", IMP}, {"EOR", IZX}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"EOR", ZP}, {"LSR", ZP}, {"???", IMP},
+    {"PHA", IMP}, {"EOR", IMM}, {"LSR", ACC}, {"???", IMP}, {"JMP", ABS}, {"EOR", ABS}, {"LSR", ABS}, {"???", IMP},
+    {"BVC", REL}, {"EOR", IZY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"EOR", ZPX}, {"LSR", ZPX}, {"???", IMP},
+    {"CLI", IMP}, {"EOR", ABY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"EOR", ABX}, {"LSR", ABX}, {"???", IMP},
+    {"RTS", IMP}, {"ADC", IZX}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"ADC", ZP}, {"ROR", ZP}, {"???", IMP},
+    {"PLA", IMP}, {"ADC", IMM}, {"ROR", ACC}, {"???", IMP}, {"JMP", IND}, {"ADC", ABS}, {"ROR", ABS}, {"???", IMP},
+    {"BVS", REL}, {"ADC", IZY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"ADC", ZPX}, {"ROR", ZPX}, {"???", IMP},
+    {"SEI", IMP}, {"ADC", ABY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"ADC", ABX}, {"ROR", ABX}, {"???", IMP},
+    {"???", IMP}, {"STA", IZX}, {"???", IMP}, {"???", IMP}, {"STY", ZP}, {"STA", ZP}, {"STX", ZP}, {"???", IMP},
+    {"DEY", IMP}, {"???", IMP}, {"TXA", IMP}, {"???", IMP}, {"STY", ABS}, {"STA", ABS}, {"STX", ABS}, {"???", IMP},
+    {"BCC", REL}, {"STA", IZY}, {"???", IMP}, {"???", IMP}, {"STY", ZPX}, {"STA", ZPX}, {"STX", ZPY}, {"???", IMP},
+    {"TYA", IMP}, {"STA", ABY}, {"TXS", IMP}, {"???", IMP}, {"???", IMP}, {"STA", ABX}, {"???", IMP}, {"???", IMP},
+    {"LDY", IMM}, {"LDA", IZX}, {"LDX", IMM}, {"???", IMP}, {"LDY", ZP}, {"LDA", ZP}, {"LDX", ZP}, {"???", IMP},
+    {"TAY", IMP}, {"LDA", IMM}, {"TAX", IMP}, {"???", IMP}, {"LDY", ABS}, {"LDA", ABS}, {"LDX", ABS}, {"???", IMP},
+    {"BCS", REL}, {"LDA", IZY}, {"???", IMP}, {"???", IMP}, {"LDY", ZPX}, {"LDA", ZPX}, {"LDX", ZPY}, {"???", IMP},
+    {"CLV", IMP}, {"LDA", ABY}, {"TSX", IMP}, {"???", IMP}, {"LDY", ABX}, {"LDA", ABX}, {"LDX", ABY}, {"???", IMP},
+    {"CPY", IMM}, {"CMP", IZX}, {"???", IMP}, {"???", IMP}, {"CPY", ZP}, {"CMP", ZP}, {"DEC", ZP}, {"???", IMP},
+    {"INY", IMP}, {"CMP", IMM}, {"DEX", IMP}, {"???", IMP}, {"CPY", ABS}, {"CMP", ABS}, {"DEC", ABS}, {"???", IMP},
+    {"BNE", REL}, {"CMP", IZY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"CMP", ZPX}, {"DEC", ZPX}, {"???", IMP},
+    {"CLD", IMP}, {"CMP", ABY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"CMP", ABX}, {"DEC", ABX}, {"???", IMP},
+    {"CPX", IMM}, {"SBC", IZX}, {"???", IMP}, {"???", IMP}, {"CPX", ZP}, {"SBC", ZP}, {"INC", ZP}, {"???", IMP},
+    {"INX", IMP}, {"SBC", IMM}, {"NOP", IMP}, {"???", IMP}, {"CPX", ABS}, {"SBC", ABS}, {"INC", ABS}, {"???", IMP},
+    {"BEQ", REL}, {"SBC", IZY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"SBC", ZPX}, {"INC", ZPX}, {"???", IMP},
+    {"SED", IMP}, {"SBC", ABY}, {"???", IMP}, {"???", IMP}, {"???", IMP}, {"SBC", ABX}, {"INC", ABX}, {"???", IMP},
+};
+
+// =====================================================================================================================
+static void disassemble(const CpuTraceRecord& record, char* output, size_t size)
+{
+    const Opcode& op = s_opcodes[record.m_opcode[0]];
+    unsigned byte = record.m_opcode[1];
+    unsigned word = record.m_opcode[1] | (record.m_opcode[2] << 8);
+
+    switch (op.m_mode)
+    {
+	case IMP : snprintf(output, size, "%s", op.m_mnemonic); break;
+	case ACC : snprintf(output, size, "%s A", op.m_mnemonic); break;
+	case IMM : snprintf(output, size, "%s #$%02x", op.m_mnemonic, byte); break;
+	case ZP : snprintf(output, size, "%s $%02x", op.m_mnemonic, byte); break;
+	case ZPX : snprintf(output, size, "%s $%02x,X", op.m_mnemonic, byte); break;
+	case ZPY : snprintf(output, size, "%s $%02x,Y", op.m_mnemonic, byte); break;
+	case ABS : snprintf(output, size, "%s $%04x", op.m_mnemonic, word); break;
+	case ABX : snprintf(output, size, "%s $%04x,X", op.m_mnemonic, word); break;
+	case ABY : snprintf(output, size, "%s $%04x,Y", op.m_mnemonic, word); break;
+	case IND : snprintf(output, size, "%s ($%04x)", op.m_mnemonic, word); break;
+	case IZX : snprintf(output, size, "%s ($%02x,X)", op.m_mnemonic, byte); break;
+	case IZY : snprintf(output, size, "%s ($%02x),Y", op.m_mnemonic, byte); break;
+
+	case REL :
+	    // the branch target relative to the following instruction
+	    snprintf(output, size, "%s $%04x", op.m_mnemonic, (record.m_PC + 2 + int8_t(byte)) & 0xffff);
+	    break;
+    }
+}
+
+// =====================================================================================================================
+int main(int argc, char** argv)
+{
+    static const option options[] = {
+	{"last", required_argument, nullptr, 'l'},
+	{nullptr, 0, nullptr, 0}
+    };
+
+    uint64_t last = 0;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1)
+    {
+	switch (opt)
+	{
+	    case 'l' :
+		last = strtoull(optarg, nullptr, 10);
+		break;
+
+	    default :
+		fprintf(stderr, "Usage: %s [--last N] trace\n", argv[0]);
+		return 1;
+	}
+    }
+
+    if (optind != argc - 1)
+    {
+	fprintf(stderr, "Usage: %s [--last N] trace\n", argv[0]);
+	return 1;
+    }
+
+    try
+    {
+	memory::MappedFile file(argv[optind]);
+
+	CpuTraceHeader header;
+
+	if (file.size() < sizeof(header))
+	{
+	    fprintf(stderr, "%s: not a trace file\n", argv[optind]);
+	    return 1;
+	}
+
+	memcpy(&header, file.data(), sizeof(header));
+
+	if (memcmp(header.m_magic, CpuTrace::s_magic, sizeof(header.m_magic)) != 0 ||
+	    header.m_version != CpuTrace::s_version || header.m_recordSize != sizeof(CpuTraceRecord) ||
+	    header.m_capacity == 0 || file.size() < sizeof(header) + uint64_t(header.m_capacity) * sizeof(CpuTraceRecord))
+	{
+	    fprintf(stderr, "%s: not a trace file of this version\n", argv[optind]);
+	    return 1;
+	}
+
+	const CpuTraceRecord* records = reinterpret_cast<const CpuTraceRecord*>(file.data() + sizeof(header));
+
+	// only the newest records are left once the ring wrapped around
+	uint64_t count = header.m_count;
+	uint64_t first = count > header.m_capacity ? count - header.m_capacity : 0;
+
+	if (last != 0 && count - first > last)
+	    first = count - last;
+
+	if (first != 0)
+	    fprintf(stderr, "%llu older instructions were overwritten\n", (unsigned long long)first);
+
+	char inst[32];
+
+	for (uint64_t i = first; i < count; ++i)
+	{
+	    const CpuTraceRecord& r = records[i % header.m_capacity];
+
+	    disassemble(r, inst, sizeof(inst));
+
+	    printf("t=%08llx CPU [PC=%04x A=%02x X=%02x Y=%02x S=%02x SP=%02x int=%c] %s\n",
+		   (unsigned long long)r.m_tick, r.m_PC, r.m_A, r.m_X, r.m_Y, r.m_status, r.m_SP,
+		   (r.m_flags & CpuTraceRecord::IN_INTERRUPT) ? 'Y' : 'N', inst);
+	}
+    }
+    catch (const std::system_error& e)
+    {
+	fprintf(stderr, "%s\n", e.what());
+	return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,285 @@
+#include <nemu/videorecorder.h>
+#include <nemu/memory/mappedfile.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include <getopt.h>
+#include <unistd.h>
+
+// Converts a video recorded by nemu --record to a YUV4MPEG2 (4:4:4) stream on stdout. Frames dropped or skipped while
+// recording are filled with the frame before them so the stream keeps the frame rate. Frames are numbered by their
+// position in the recording.
+
+// =====================================================================================================================
+static bool getVarint(const uint8_t*& p, const uint8_t* end, uint32_t& value)
+{
+    value = 0;
+
+    for (unsigned shift = 0; p < end && shift < 32; shift += 7)
+    {
+	uint8_t byte = *p++;
+	value |= uint32_t(byte & 0x7f) << shift;
+
+	if ((byte & 0x80) == 0)
+	    return true;
+    }
+
+    return false;
+}
+
+// =====================================================================================================================
+static bool decodeFrame(const VideoFrameHeader& header, const uint8_t* payload, uint8_t* frame)
+{
+    if (header.m_type == VideoFrameHeader::KEY)
+    {
+	if (header.m_size != VideoRecorder::FRAME_SIZE)
+	    return false;
+
+	memcpy(frame, payload, VideoRecorder::FRAME_SIZE);
+	return true;
+    }
+
+    if (header.m_type != VideoFrameHeader::DELTA)
+	return false;
+
+    const uint8_t* p = payload;
+    const uint8_t* end = payload + header.m_size;
+    uint32_t pos = 0;
+
+    while (p < end)
+    {
+	uint32_t skip, count;
+
+	if (!getVarint(p, end, skip) || !getVarint(p, end, count))
+	    return false;
+
+	pos += skip;
+
+	if (pos > VideoRecorder::FRAME_SIZE || count > VideoRecorder::FRAME_SIZE - pos || count > uint32_t(end - p))
+	    return false;
+
+	memcpy(frame + pos, p, count);
+	p += count;
+	pos += count;
+    }
+
+    return true;
+}
+
+/// the Y, Cb and Cr planes of a frame, BT.601 studio range
+struct YuvConverter
+{
+    YuvConverter(const VideoHeader& header)
+    {
+	for (unsigned i = 0; i < 64; ++i)
+	{
+	    double r = (header.m_palette[i] >> 16) & 0xff;
+	    double g = (header.m_palette[i] >> 8) & 0xff;
+	    double b = header.m_palette[i] & 0xff;
+
+	    m_y[i] = uint8_t(16.5 + (65.481 * r + 128.553 * g + 24.966 * b) / 255.0);
+	    m_cb[i] = uint8_t(128.5 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255.0);
+	    m_cr[i] = uint8_t(128.5 + (112.0 * r - 93.786 * g - 18.214 * b) / 255.0);
+	}
+    }
+
+    void convert(const uint8_t* frame, uint8_t* planes) const
+    {
+	const unsigned size = VideoRecorder::FRAME_SIZE;
+
+	for (unsigned i = 0; i < size; ++i)
+	{
+	    unsigned index = frame[i] & 0x3f;
+
+	    planes[i] = m_y[index];
+	    planes[size + i] = m_cb[index];
+	    planes[2 * size + i] = m_cr[index];
+	}
+    }
+
+    uint8_t m_y[64];
+    uint8_t m_cb[64];
+    uint8_t m_cr[64];
+};
+
+// =====================================================================================================================
+static void writeFrame(const std::vector<uint8_t>& planes)
+{
+    fputs("FRAME\n", stdout);
+    fwrite(planes.data(), 1, planes.size(), stdout);
+}
+
+// =====================================================================================================================
+static uint64_t findStart(const std::string& indexFile, uint32_t from, uint64_t fileSize)
+{
+    // without an index the video is decoded from its first frame
+    std::unique_ptr<memory::MappedFile> index;
+
+    try
+    {
+	index.reset(new memory::MappedFile(indexFile));
+    }
+    catch (const std::system_error&)
+    {
+	return sizeof(VideoHeader);
+    }
+
+    const VideoIndexEntry* entries = reinterpret_cast<const VideoIndexEntry*>(index->data());
+    size_t count = index->size() / sizeof(VideoIndexEntry);
+    uint64_t start = sizeof(VideoHeader);
+
+    // the last key frame at or before the first frame wanted, the recorder numbers the frames in ascending order
+    for (size_t i = 0; i < count && entries[i].m_frame <= from; ++i)
+    {
+	if (entries[i].m_type == VideoFrameHeader::KEY && entries[i].m_offset < fileSize)
+	    start = entries[i].m_offset;
+    }
+
+    return start;
+}
+
+// =====================================================================================================================
+int main(int argc, char** argv)
+{
+    static const option options[] = {
+	{"from", required_argument, nullptr, 'f'},
+	{"count", required_argument, nullptr, 'c'},
+	{nullptr, 0, nullptr, 0}
+    };
+
+    uint32_t from = 0;
+    uint32_t count = 0;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1)
+    {
+	switch (opt)
+	{
+	    case 'f' :
+		from = strtoul(optarg, nullptr, 10);
+		break;
+
+	    case 'c' :
+		count = strtoul(optarg, nullptr, 10);
+		break;
+
+	    default :
+		fprintf(stderr, "Usage: %s [--from FRAME] [--count N] video > video.y4m\n", argv[0]);
+		return 1;
+	}
+    }
+
+    if (optind != argc - 1)
+    {
+	fprintf(stderr, "Usage: %s [--from FRAME] [--count N] video > video.y4m\n", argv[0]);
+	return 1;
+    }
+
+    if (isatty(STDOUT_FILENO))
+    {
+	fprintf(stderr, "Refusing to write a video to a terminal\n");
+	return 1;
+    }
+
+    try
+    {
+	memory::MappedFile file(argv[optind]);
+
+	VideoHeader header;
+
+	if (file.size() < sizeof(header))
+	{
+	    fprintf(stderr, "%s: not a video file\n", argv[optind]);
+	    return 1;
+	}
+
+	memcpy(&header, file.data(), sizeof(header));
+
+	if (memcmp(header.m_magic, VideoRecorder::s_magic, sizeof(header.m_magic)) != 0 ||
+	    header.m_version != VideoRecorder::s_version || header.m_width != VideoRecorder::WIDTH ||
+	    header.m_height != VideoRecorder::HEIGHT)
+	{
+	    fprintf(stderr, "%s: not a video file of this version\n", argv[optind]);
+	    return 1;
+	}
+
+	YuvConverter converter(header);
+
+	std::vector<uint8_t> frame(VideoRecorder::FRAME_SIZE);
+	std::vector<uint8_t> planes(3 * VideoRecorder::FRAME_SIZE);
+
+	printf("YUV4MPEG2 W%u H%u F%u:%u Ip A8:7 C444\n", header.m_width, header.m_height, header.m_rateNumerator,
+	       header.m_rateDenominator);
+
+	uint64_t offset = findStart(std::string(argv[optind]) + ".idx", from, file.size());
+	uint32_t written = 0;
+	// the frame number following the last frame written
+	uint32_t next = 0;
+	bool decoded = false;
+
+	while (offset + sizeof(VideoFrameHeader) <= file.size() && (count == 0 || written < count))
+	{
+	    VideoFrameHeader frameHeader;
+	    memcpy(&frameHeader, file.data() + offset, sizeof(frameHeader));
+	    offset += sizeof(frameHeader);
+
+	    // a recording cut short by a crash ends with a partial frame
+	    if (frameHeader.m_size > file.size() - offset)
+		break;
+
+	    // a delta frame is only usable after the frame it was encoded against
+	    if (!decoded && frameHeader.m_type != VideoFrameHeader::KEY)
+	    {
+		offset += frameHeader.m_size;
+		continue;
+	    }
+
+	    if (!decodeFrame(frameHeader, file.data() + offset, frame.data()))
+	    {
+		fprintf(stderr, "%s: corrupt frame %u\n", argv[optind], frameHeader.m_frame);
+		return 1;
+	    }
+
+	    offset += frameHeader.m_size;
+	    decoded = true;
+
+	    if (frameHeader.m_frame < from)
+		continue;
+
+	    // the frames dropped before this one repeat the frame before them
+	    if (written != 0)
+	    {
+		for (; next < frameHeader.m_frame && (count == 0 || written < count); ++next, ++written)
+		    writeFrame(planes);
+
+		if (count != 0 && written == count)
+		    break;
+	    }
+
+	    converter.convert(frame.data(), planes.data());
+	    writeFrame(planes);
+	    ++written;
+	    next = frameHeader.m_frame + 1;
+	}
+
+	if (fflush(stdout) != 0)
+	{
+	    perror("write");
+	    return 1;
+	}
+
+	fprintf(stderr, "%u frames\n", written);
+    }
+    catch (const std::system_error& e)
+    {
+	fprintf(stderr, "%s\n", e.what());
+	return 1;
+    }
+
+    return 0;
+}